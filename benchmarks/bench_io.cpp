@@ -0,0 +1,77 @@
+#include <benchmark/benchmark.h>
+
+#include "fixtures.h"
+#include "io/hdf5/reader.h"
+#include "io/tiff/tiffio.h"
+
+using namespace tomocam;
+
+// args: {nslices, nrows/ncols}
+static void sizes(benchmark::internal::Benchmark *b) {
+    b->Args({16, 512})->Args({64, 1024})->Unit(benchmark::kMillisecond);
+}
+
+static void BM_H5Read2(benchmark::State &state) {
+    uint32_t nslc = state.range(0);
+    uint32_t n = state.range(1);
+    bench::ScratchDir dir("h5read2");
+    auto file = dir.path() / "vol.h5";
+    bench::write_h5_fixture(file, "recon", bench::synthetic_volume(nslc, n, n));
+
+    for (auto _ : state) {
+        h5::Reader reader(file.string().c_str());
+        auto vol = reader.read2<float>("recon");
+        benchmark::DoNotOptimize(vol.begin());
+    }
+    double voxels = double(nslc) * n * n;
+    bench::set_throughput(state, voxels * sizeof(float), voxels);
+}
+BENCHMARK(BM_H5Read2)->Apply(sizes);
+
+static void BM_H5ReadSinogram(benchmark::State &state) {
+    uint32_t nslc = state.range(0);
+    uint32_t n = state.range(1);
+    bench::ScratchDir dir("h5sino");
+    auto file = dir.path() / "proj.h5";
+    bench::write_h5_fixture(file, "tomo", bench::synthetic_volume(nslc, n, n));
+
+    for (auto _ : state) {
+        h5::Reader reader(file.string().c_str());
+        auto sino = reader.read_sinogram<float>("tomo");
+        benchmark::DoNotOptimize(sino.begin());
+    }
+    double voxels = double(nslc) * n * n;
+    bench::set_throughput(state, voxels * sizeof(float), voxels);
+}
+BENCHMARK(BM_H5ReadSinogram)->Apply(sizes);
+
+static void BM_TiffRead(benchmark::State &state) {
+    uint32_t nslc = state.range(0);
+    uint32_t n = state.range(1);
+    bench::ScratchDir dir("tiffread");
+    auto file = dir.path() / "vol.tif";
+    bench::write_tiff_fixture(file, bench::synthetic_volume(nslc, n, n));
+
+    for (auto _ : state) {
+        auto vol = tiff::read<float>(file.string());
+        benchmark::DoNotOptimize(vol.begin());
+    }
+    double voxels = double(nslc) * n * n;
+    bench::set_throughput(state, voxels * sizeof(float), voxels);
+}
+BENCHMARK(BM_TiffRead)->Apply(sizes);
+
+static void BM_TiffWrite(benchmark::State &state) {
+    uint32_t nslc = state.range(0);
+    uint32_t n = state.range(1);
+    bench::ScratchDir dir("tiffwrite");
+    auto file = dir.path() / "vol.tif";
+    auto vol = bench::synthetic_volume(nslc, n, n);
+
+    for (auto _ : state) {
+        tiff::write(file.string(), vol);
+    }
+    double voxels = double(nslc) * n * n;
+    bench::set_throughput(state, voxels * sizeof(float), voxels);
+}
+BENCHMARK(BM_TiffWrite)->Apply(sizes);
@@ -0,0 +1,124 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <future>
+#include <random>
+#include <vector>
+
+#include "fixtures.h"
+#include "io/async_writer.h"
+#include "io/thread_pool.h"
+#include "save_patch.h"
+
+using namespace tomocam;
+
+// args: {nrows/ncols, patches per iteration}
+static void BM_ExportPatches(benchmark::State &state) {
+    uint32_t n = state.range(0);
+    int npatch = state.range(1);
+    bench::ScratchDir dir("patches");
+    auto vol = bench::synthetic_volume(8, n, n);
+
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<uint32_t> slc(0, vol.nslices() - 1);
+    std::uniform_int_distribution<uint32_t> pos(0, n - 1);
+
+    int counter = 0;
+    for (auto _ : state) {
+        for (int p = 0; p < npatch; p++) {
+            char pname[20];
+            snprintf(pname, 20, "%05d.tif", counter++ % 100000);
+            dims_t loc{slc(gen), pos(gen), pos(gen)};
+            save_patch((dir.path() / pname).string(), vol, loc);
+        }
+    }
+    double it = static_cast<double>(state.iterations());
+    state.counters["patches/s"] =
+        benchmark::Counter(it * npatch, benchmark::Counter::kIsRate);
+    double voxels = double(npatch) * PATCH_SIZE * PATCH_SIZE;
+    bench::set_throughput(state, voxels * sizeof(float), voxels);
+}
+BENCHMARK(BM_ExportPatches)
+    ->Args({1024, 64})
+    ->Unit(benchmark::kMillisecond);
+
+// args: {nrows/ncols, patches per iteration, compression}
+static void BM_ExportPatchesAsync(benchmark::State &state) {
+    uint32_t n = state.range(0);
+    int npatch = state.range(1);
+    tiff::WriteOptions opts;
+    opts.compression = static_cast<tiff::Compression>(state.range(2));
+    bench::ScratchDir dir("patches_async");
+    auto vol = bench::synthetic_volume(8, n, n);
+
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<uint32_t> slc(0, vol.nslices() - 1);
+    std::uniform_int_distribution<uint32_t> pos(0, n - 1);
+
+    ThreadPool pool;
+    std::vector<std::future<void>> jobs;
+    int counter = 0;
+    for (auto _ : state) {
+        jobs.clear();
+        for (int p = 0; p < npatch; p++) {
+            char pname[20];
+            snprintf(pname, 20, "%05d.tif", counter++ % 100000);
+            dims_t loc{slc(gen), pos(gen), pos(gen)};
+            jobs.push_back(tiff::write_async(pool, (dir.path() / pname).string(),
+                patch_view(vol, loc), opts));
+        }
+        for (auto &job : jobs) job.get();
+    }
+    double it = static_cast<double>(state.iterations());
+    state.counters["patches/s"] =
+        benchmark::Counter(it * npatch, benchmark::Counter::kIsRate);
+    double voxels = double(npatch) * PATCH_SIZE * PATCH_SIZE;
+    bench::set_throughput(state, voxels * sizeof(float), voxels);
+}
+BENCHMARK(BM_ExportPatchesAsync)
+    ->Args({1024, 64, static_cast<int>(tiff::Compression::None)})
+    ->Args({1024, 64, static_cast<int>(tiff::Compression::Deflate)})
+    ->Args({1024, 64, static_cast<int>(tiff::Compression::Zstd)})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// args: {nrows/ncols, patches per iteration}
+static void BM_ExportPatchesBatched(benchmark::State &state) {
+    uint32_t n = state.range(0);
+    int npatch = state.range(1);
+    bench::ScratchDir dir("patches_batched");
+    auto vol = bench::synthetic_volume(8, n, n);
+
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<uint32_t> slc(0, vol.nslices() - 1);
+    std::uniform_int_distribution<uint32_t> pos(0, n - 1);
+
+    ThreadPool pool;
+    aio::AsyncWriter writer;
+    state.SetLabel(writer.backend());
+    std::vector<std::future<void>> jobs;
+    int counter = 0;
+    for (auto _ : state) {
+        jobs.clear();
+        for (int p = 0; p < npatch; p++) {
+            char pname[20];
+            snprintf(pname, 20, "%05d.tif", counter++ % 100000);
+            auto path = (dir.path() / pname).string();
+            auto view = patch_view(vol, dims_t{slc(gen), pos(gen), pos(gen)});
+            jobs.push_back(pool.submit([&writer, path, view] {
+                writer.submit(path, tiff::encode(view));
+            }));
+        }
+        for (auto &job : jobs) job.get();
+        writer.wait();
+    }
+    double it = static_cast<double>(state.iterations());
+    state.counters["patches/s"] =
+        benchmark::Counter(it * npatch, benchmark::Counter::kIsRate);
+    double voxels = double(npatch) * PATCH_SIZE * PATCH_SIZE;
+    bench::set_throughput(state, voxels * sizeof(float), voxels);
+}
+BENCHMARK(BM_ExportPatchesBatched)
+    ->Args({1024, 64})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
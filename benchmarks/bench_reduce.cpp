@@ -0,0 +1,49 @@
+#include <benchmark/benchmark.h>
+
+#include "fixtures.h"
+#include "io/reductions.h"
+
+using namespace tomocam;
+
+// args: {nslices, nrows/ncols}
+static void BM_MinMax(benchmark::State &state) {
+    uint32_t nslc = state.range(0);
+    uint32_t n = state.range(1);
+    auto vol = bench::synthetic_volume(nslc, n, n);
+
+    for (auto _ : state) {
+        auto mm = vol.minmax();
+        benchmark::DoNotOptimize(mm);
+    }
+    double voxels = double(nslc) * n * n;
+    bench::set_throughput(state, voxels * sizeof(float), voxels);
+}
+BENCHMARK(BM_MinMax)->Args({64, 1024})->UseRealTime()->Unit(benchmark::kMillisecond);
+
+static void BM_Moments(benchmark::State &state) {
+    uint32_t nslc = state.range(0);
+    uint32_t n = state.range(1);
+    auto vol = bench::synthetic_volume(nslc, n, n);
+
+    for (auto _ : state) {
+        auto m = reduce::moments(vol);
+        benchmark::DoNotOptimize(m);
+    }
+    double voxels = double(nslc) * n * n;
+    bench::set_throughput(state, voxels * sizeof(float), voxels);
+}
+BENCHMARK(BM_Moments)->Args({64, 1024})->UseRealTime()->Unit(benchmark::kMillisecond);
+
+static void BM_Histogram(benchmark::State &state) {
+    uint32_t nslc = state.range(0);
+    uint32_t n = state.range(1);
+    auto vol = bench::synthetic_volume(nslc, n, n);
+
+    for (auto _ : state) {
+        auto h = reduce::histogram(vol, 256, -0.5, 1.5);
+        benchmark::DoNotOptimize(h.counts.data());
+    }
+    double voxels = double(nslc) * n * n;
+    bench::set_throughput(state, voxels * sizeof(float), voxels);
+}
+BENCHMARK(BM_Histogram)->Args({64, 1024})->UseRealTime()->Unit(benchmark::kMillisecond);
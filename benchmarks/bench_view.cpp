@@ -0,0 +1,39 @@
+#include <benchmark/benchmark.h>
+
+#include "fixtures.h"
+#include "io/slice_cache.h"
+#include "qimage_utils.h"
+
+using namespace tomocam;
+
+static void BM_FloatArrayToQImage(benchmark::State &state) {
+    uint32_t n = state.range(0);
+    auto vol = bench::synthetic_volume(1, n, n);
+
+    float minVal, maxVal;
+    for (auto _ : state) {
+        QImage img = floatArrayToQImage(vol.slice(0), minVal, maxVal);
+        benchmark::DoNotOptimize(img.constBits());
+    }
+    double voxels = double(n) * n;
+    bench::set_throughput(state, voxels * sizeof(float), voxels);
+}
+BENCHMARK(BM_FloatArrayToQImage)
+    ->Arg(1024)
+    ->Arg(2560)
+    ->Unit(benchmark::kMillisecond);
+
+// lookups of resident slices from several threads, e.g. viewer and prefetch
+static void BM_SliceCacheHit(benchmark::State &state) {
+    constexpr uint32_t n = 1024, slices = 64;
+    static SliceCache<uint8_t> cache(uint64_t(n) * n * slices);
+    auto fill = [](Slice<uint8_t> dst) { std::fill(dst.ptr, dst.ptr + dst.size(), 0); };
+
+    uint32_t i = state.thread_index();
+    for (auto _ : state) {
+        auto h = cache.get({1, i++ % slices}, n, n, fill);
+        benchmark::DoNotOptimize(h.view().ptr);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SliceCacheHit)->Threads(1)->Threads(4);
@@ -0,0 +1,104 @@
+# Compare two Google Benchmark JSON reports.
+#   cmake -DBASELINE=a.json -DCURRENT=b.json -DTHRESHOLD=0.10 -P compare.cmake
+# Only the "median" aggregates are compared; a benchmark regresses when its
+# real_time grows by more than THRESHOLD relative to the baseline.
+cmake_minimum_required(VERSION 3.19)
+
+if (NOT EXISTS "${BASELINE}")
+    # baselines are machine specific; a missing one must not pass as "no regressions"
+    message(FATAL_ERROR "No baseline at ${BASELINE}; "
+                        "run the bench_baseline target on the reference machine first")
+endif()
+if (NOT DEFINED THRESHOLD)
+    set(THRESHOLD 0.10)
+endif()
+
+file(READ "${BASELINE}" base_json)
+file(READ "${CURRENT}" curr_json)
+
+function(collect_medians json prefix)
+    string(JSON n LENGTH "${json}" benchmarks)
+    set(names "")
+    if (n GREATER 0)
+        math(EXPR last "${n} - 1")
+        foreach(i RANGE ${last})
+            string(JSON agg ERROR_VARIABLE err GET "${json}" benchmarks ${i} aggregate_name)
+            if (NOT agg STREQUAL "median")
+                continue()
+            endif()
+            string(JSON name GET "${json}" benchmarks ${i} run_name)
+            string(JSON t GET "${json}" benchmarks ${i} real_time)
+            string(MAKE_C_IDENTIFIER "${name}" key)
+            set(${prefix}_${key} ${t} PARENT_SCOPE)
+            list(APPEND names "${name}")
+        endforeach()
+    endif()
+    set(${prefix}_names ${names} PARENT_SCOPE)
+endfunction()
+
+# "12.3456" -> 12345, "1.2345e+06" -> 1234500000
+function(to_milli value out)
+    if (value MATCHES "^([0-9]+)(\\.([0-9]*))?([eE]([+-]?[0-9]+))?$")
+        set(digits "${CMAKE_MATCH_1}${CMAKE_MATCH_3}")
+        string(LENGTH "${CMAKE_MATCH_3}" nfrac)
+        set(exp "${CMAKE_MATCH_5}")
+        if (exp STREQUAL "")
+            set(exp 0)
+        endif()
+        # value * 1000 = digits * 10^(exp - nfrac + 3)
+        math(EXPR shift "${exp} - ${nfrac} + 3")
+        string(REGEX REPLACE "^0+([0-9])" "\\1" v "${digits}")
+        while (shift GREATER 0)
+            string(APPEND v "0")
+            math(EXPR shift "${shift} - 1")
+        endwhile()
+        if (shift LESS 0)
+            math(EXPR keep "-(${shift})")
+            string(LENGTH "${v}" len)
+            math(EXPR len "${len} - ${keep}")
+            if (len GREATER 0)
+                string(SUBSTRING "${v}" 0 ${len} v)
+            else()
+                set(v 0)
+            endif()
+        endif()
+        math(EXPR v "${v}")
+    else()
+        message(WARNING "cannot parse time ${value}")
+        set(v 0)
+    endif()
+    set(${out} ${v} PARENT_SCOPE)
+endfunction()
+
+to_milli("${THRESHOLD}" thr_pm)
+collect_medians("${base_json}" base)
+collect_medians("${curr_json}" curr)
+
+set(failed 0)
+foreach(name IN LISTS curr_names)
+    string(MAKE_C_IDENTIFIER "${name}" key)
+    if (NOT DEFINED base_${key})
+        message(STATUS "NEW      ${name}")
+        continue()
+    endif()
+    set(b ${base_${key}})
+    set(c ${curr_${key}})
+    # math() only does integers, compare in thousandths of the time unit
+    to_milli("${b}" b_m)
+    to_milli("${c}" c_m)
+    if (b_m EQUAL 0)
+        set(b_m 1)
+    endif()
+    math(EXPR ratio_pm "(${c_m} * 1000) / ${b_m}")
+    math(EXPR limit_pm "1000 + ${thr_pm}")
+    if (ratio_pm GREATER limit_pm)
+        message(STATUS "SLOWER   ${name}: ${b} -> ${c} (${ratio_pm} per mille)")
+        set(failed 1)
+    else()
+        message(STATUS "OK       ${name}: ${b} -> ${c} (${ratio_pm} per mille)")
+    endif()
+endforeach()
+
+if (failed)
+    message(FATAL_ERROR "Benchmark regressions above ${THRESHOLD} detected")
+endif()
@@ -0,0 +1,81 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <random>
+#include <string>
+
+#include "io/array.h"
+#include "io/hdf5/writer.h"
+#include "io/tiff/tiffio.h"
+
+#ifndef BENCH_FIXTURES__H
+#define BENCH_FIXTURES__H
+
+namespace fs = std::filesystem;
+
+namespace tomocam::bench {
+
+    // synthetic volume: a bright disk over noise, roughly what a
+    // reconstruction looks like after the field-of-view mask
+    inline Array<float> synthetic_volume(uint32_t nslc, uint32_t nrow,
+        uint32_t ncol) {
+        Array<float> vol(nslc, nrow, ncol);
+        std::mt19937 gen(42);
+        std::normal_distribution<float> noise(0.f, 0.05f);
+        float cy = 0.5f * nrow;
+        float cx = 0.5f * ncol;
+        float r2 = 0.16f * nrow * ncol;
+        for (uint32_t i = 0; i < nslc; i++)
+            for (uint32_t j = 0; j < nrow; j++)
+                for (uint32_t k = 0; k < ncol; k++) {
+                    float dy = j - cy;
+                    float dx = k - cx;
+                    float v = (dy * dy + dx * dx < r2) ? 1.f : 0.f;
+                    vol[{i, j, k}] = v + noise(gen);
+                }
+        return vol;
+    }
+
+    // scratch directory removed when the fixture goes out of scope
+    class ScratchDir {
+      private:
+        fs::path path_;
+
+      public:
+        ScratchDir(const std::string &tag) {
+            path_ = fs::temp_directory_path() /
+                    ("tomoview_bench_" + tag + "_" +
+                        std::to_string(std::random_device{}()));
+            fs::create_directories(path_);
+        }
+        ~ScratchDir() {
+            std::error_code ec;
+            fs::remove_all(path_, ec);
+        }
+        const fs::path &path() const { return path_; }
+    };
+
+    inline void write_h5_fixture(const fs::path &file, const char *dset,
+        const Array<float> &vol) {
+        h5::Writer w(file.string().c_str());
+        w.write(dset, vol);
+    }
+
+    inline void write_tiff_fixture(const fs::path &file,
+        const Array<float> &vol) {
+        tiff::write(file.string(), vol);
+    }
+
+    // report throughput in the units we track for the beamline
+    inline void set_throughput(benchmark::State &state, double bytes,
+        double voxels) {
+        double it = static_cast<double>(state.iterations());
+        state.SetBytesProcessed(static_cast<int64_t>(it * bytes));
+        state.counters["MB/s"] = benchmark::Counter(it * bytes / 1.0e6,
+            benchmark::Counter::kIsRate);
+        state.counters["voxels/s"] =
+            benchmark::Counter(it * voxels, benchmark::Counter::kIsRate);
+    }
+} // namespace tomocam::bench
+#endif // BENCH_FIXTURES__H
@@ -0,0 +1,112 @@
+"""Reader for the patch ring written by ``tomoview_batch -S NAME``.
+
+The layout and the queue protocol are described in src/io/shm_ring.h.
+Shared words are read and written with plain aligned 8 and 4 byte
+accesses, which are atomic and ordered enough on x86-64; other
+architectures need real acquire/release operations.
+
+    from tomoview_ring import RingReader
+    with RingReader("tomoview") as ring:
+        for meta, patch in ring:
+            tag, slice_, y0, x0 = meta
+            ...
+"""
+
+import mmap
+import os
+import struct
+import time
+
+import numpy as np
+
+MAGIC = 0x474E49524F4D4F54  # "TOMORING"
+VERSION = 2
+SLOT_HEADER_BYTES = 64
+
+_HEAD, _TAIL, _CLOSED = 64, 128, 192
+
+
+class RingReader:
+    """Single consumer of a ring; the ring must not have another reader."""
+
+    def __init__(self, name, wait=30.0):
+        path = "/dev/shm/" + name.lstrip("/")
+        deadline = time.monotonic() + wait
+        while True:
+            try:
+                fd = os.open(path, os.O_RDWR)
+                try:
+                    self._mm = mmap.mmap(fd, 0)
+                finally:
+                    os.close(fd)
+                if struct.unpack_from("<Q", self._mm, 0)[0] == MAGIC:
+                    break
+                self._mm.close()
+            except (FileNotFoundError, ValueError):
+                pass
+            if time.monotonic() > deadline:
+                raise TimeoutError("no ring named " + name)
+            time.sleep(0.05)
+
+        (_, version, self.header_bytes, self.slots, self.stride, self.item_bytes,
+         ndim) = struct.unpack_from("<QIIIIII", self._mm, 0)
+        if version != VERSION:
+            raise ValueError("unsupported ring version %d" % version)
+        self.ndim = ndim
+        self.shape = struct.unpack_from("<4I", self._mm, 32)[:ndim]  # largest item
+        self.dtype = np.dtype(self._mm[48:56].split(b"\0")[0].decode())
+        self._tail = self._u64(_TAIL)
+
+    def _u64(self, off):
+        return struct.unpack_from("<Q", self._mm, off)[0]
+
+    def _slot(self, pos):
+        return self.header_bytes + (pos & (self.slots - 1)) * self.stride
+
+    def get(self, timeout=None):
+        """Next (meta, patch), or None once the ring is closed and drained.
+
+        meta is (tag, slice, y0, x0); patch is a copy in the item's own
+        shape, at most self.shape. The slot is handed back to the producer
+        before returning. Raises TimeoutError if nothing arrives within
+        timeout seconds.
+        """
+        pos = self._tail
+        off = self._slot(pos)
+        deadline = None if timeout is None else time.monotonic() + timeout
+        while self._u64(off) != pos + 1:
+            closed = struct.unpack_from("<I", self._mm, _CLOSED)[0]
+            if closed and self._u64(_HEAD) == pos:
+                return None
+            if deadline is not None and time.monotonic() > deadline:
+                raise TimeoutError("ring producer stalled")
+            time.sleep(50e-6)
+
+        nbytes = struct.unpack_from("<I", self._mm, off + 8)[0]
+        meta = struct.unpack_from("<4q", self._mm, off + 16)
+        shape = struct.unpack_from("<4I", self._mm, off + 48)[:self.ndim]
+        data = np.frombuffer(self._mm, self.dtype, nbytes // self.dtype.itemsize,
+                             off + SLOT_HEADER_BYTES)
+        patch = data.reshape(shape).copy()
+        del data  # an exported buffer would keep close() from unmapping
+
+        struct.pack_into("<Q", self._mm, off, pos + self.slots)
+        self._tail = pos + 1
+        struct.pack_into("<Q", self._mm, _TAIL, self._tail)
+        return meta, patch
+
+    def __iter__(self):
+        while True:
+            item = self.get()
+            if item is None:
+                return
+            yield item
+
+    def close(self):
+        self._mm.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
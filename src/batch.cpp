@@ -0,0 +1,213 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fov_detect.h"
+#include "io/array.h"
+#include "io/loader.h"
+#include "io/shm_ring.h"
+#include "io/tiff/tiffio.h"
+#include "patch_sampler.h"
+#include "save_patch.h"
+#include "volume_export.h"
+
+// Extract patches from many scans without the GUI: the field of view of
+// every scan is detected, then patches are sampled inside it.
+
+namespace fs = std::filesystem;
+
+static void usage(const char *prog) {
+    std::fprintf(stderr,
+                 "usage: %s [options] scan...\n"
+                 "  -o DIR     output root, patches go to DIR/<scan name>/ (default .)\n"
+                 "  -n N       patches per slice, or per slab with -d (default 1)\n"
+                 "  -d DEPTH   write DEPTH-slice sub-volumes to volumes_NNN.h5 instead of tiffs\n"
+                 "  -D NAME    HDF5 dataset to read (default recon, else the first 3D one)\n"
+                 "  -c CODEC   tiff compression: none, lzw, deflate, zstd (default none)\n"
+                 "  -z         write a Zarr store (patches_NNN.zarr or volumes_NNN.zarr), -c none or deflate\n"
+                 "  -q         reject mostly empty patches\n"
+                 "  -s SEED    random seed (default: random)\n"
+                 "  -m         fit the field of view on the mean projection\n"
+                 "  -S NAME    stream patches to the shared memory ring NAME, no files\n"
+                 "  -r SLOTS   ring slots with -S (default 64)\n",
+                 prog);
+}
+
+static bool parse_codec(const char *s, tomocam::tiff::Compression &c) {
+    using tomocam::tiff::Compression;
+    if (!std::strcmp(s, "none"))
+        c = Compression::None;
+    else if (!std::strcmp(s, "lzw"))
+        c = Compression::LZW;
+    else if (!std::strcmp(s, "deflate"))
+        c = Compression::Deflate;
+    else if (!std::strcmp(s, "zstd"))
+        c = Compression::Zstd;
+    else
+        return false;
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    fs::path outdir = ".";
+    int per_slice = 1;
+    uint32_t depth = 0;
+    tomocam::tiff::WriteOptions tiffOptions;
+    tomocam::QualityFilter filter;
+    tomocam::DetectOptions detect;
+    std::mt19937 rng(std::random_device{}());
+    std::vector<std::string> scans;
+    bool zarr = false;
+    std::string dataset;
+    std::string ring_name;
+    uint32_t ring_slots = 64;
+    auto timeout = std::chrono::seconds(30);
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "-o" && has_value) {
+            outdir = argv[++i];
+        } else if (arg == "-n" && has_value) {
+            per_slice = std::atoi(argv[++i]);
+        } else if (arg == "-d" && has_value) {
+            depth = static_cast<uint32_t>(std::atoi(argv[++i]));
+        } else if (arg == "-D" && has_value) {
+            dataset = argv[++i];
+        } else if (arg == "-c" && has_value) {
+            if (!parse_codec(argv[++i], tiffOptions.compression)) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (arg == "-s" && has_value) {
+            rng.seed(static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10)));
+        } else if (arg == "-S" && has_value) {
+            ring_name = argv[++i];
+            if (ring_name[0] != '/') ring_name = "/" + ring_name;
+        } else if (arg == "-r" && has_value) {
+            ring_slots = static_cast<uint32_t>(std::atoi(argv[++i]));
+        } else if (arg == "-z") {
+            zarr = true;
+        } else if (arg == "-q") {
+            filter.enabled = true;
+        } else if (arg == "-m") {
+            detect.use_max = false;
+        } else if (arg == "-h" || arg == "--help") {
+            usage(argv[0]);
+            return 0;
+        } else if (!arg.empty() && arg[0] == '-') {
+            usage(argv[0]);
+            return 2;
+        } else {
+            scans.push_back(arg);
+        }
+    }
+    using tomocam::tiff::Compression;
+    bool zarr_codec = tiffOptions.compression == Compression::None ||
+                      tiffOptions.compression == Compression::Deflate;
+    if (scans.empty() || per_slice < 1 || (!ring_name.empty() && (depth > 0 || ring_slots < 1)) ||
+        (zarr && (!zarr_codec || !ring_name.empty()))) {
+        usage(argv[0]);
+        return 2;
+    }
+    // zlib level of Zarr chunks, 0 stores them raw
+    int zarr_level = 0;
+    if (tiffOptions.compression == Compression::Deflate)
+        zarr_level = tiffOptions.level > 0 ? tiffOptions.level : 6;
+
+    // created on the first scan, once the patch shape is known
+    std::unique_ptr<tomocam::shm::Ring> ring;
+
+    int failed = 0;
+    for (size_t n = 0; n < scans.size(); n++) {
+        const auto &scan = scans[n];
+        if (!fs::exists(scan)) {
+            std::fprintf(stderr, "%s: no such file\n", scan.c_str());
+            failed++;
+            continue;
+        }
+        try {
+            // HDF5 sub-volumes are detected and cut slab by slab, straight
+            // from the file; everything else loads the whole volume
+            bool stream = depth > 0 && !zarr && fs::path(scan).extension() == ".h5";
+            std::unique_ptr<tomocam::h5::Reader> reader;
+            std::string name;
+            tomocam::Array<float> vol;
+            tomocam::Detection d;
+            if (stream) {
+                reader = std::make_unique<tomocam::h5::Reader>(scan.c_str());
+                if (!reader->valid()) throw std::runtime_error("cannot open " + scan);
+                name = dataset.empty() ? tomocam::default_dataset(*reader) : dataset;
+                d = tomocam::detect_fov(*reader, name.c_str(), tomocam::Roi{}, detect);
+            } else {
+                vol = tomocam::loader(scan, tomocam::Roi{}, {}, dataset);
+                d = tomocam::detect_fov(vol, detect);
+            }
+            if (!d.ok) {
+                std::fprintf(stderr, "%s: field of view not found (%.0f%% of %zu edge points fit)\n",
+                             scan.c_str(), 100.0 * d.inliers, d.edge_points);
+                failed++;
+                continue;
+            }
+
+            fs::path dir = outdir / fs::path(scan).stem();
+            if (ring_name.empty()) fs::create_directories(dir);
+            tomocam::SampleStats stats;
+            if (!ring_name.empty()) {
+                // slots fit a full patch; smaller scans send smaller items
+                if (!ring)
+                    ring = std::make_unique<tomocam::shm::Ring>(tomocam::shm::Ring::create<float>(
+                        ring_name, ring_slots, {tomocam::PATCH_SIZE, tomocam::PATCH_SIZE}));
+                auto locs = tomocam::sample_patches(vol, d.fov, per_slice, filter, rng, stats);
+                tomocam::stream_patches(vol, locs, *ring, int64_t(n), timeout);
+            } else if (depth > 0) {
+                tomocam::VolumeExport opts;
+                opts.filename = tomocam::next_output(dir, "volumes", zarr ? ".zarr" : ".h5").string();
+                opts.depth = depth;
+                opts.per_slab = per_slice;
+                if (zarr) opts.deflate = zarr_level;
+                stats = stream ? tomocam::export_volumes<float>(*reader, name.c_str(), tomocam::Roi{},
+                                                                d.fov, opts, filter, rng)
+                               : tomocam::export_volumes(vol, d.fov, opts, filter, rng);
+            } else if (zarr) {
+                auto locs = tomocam::sample_patches(vol, d.fov, per_slice, filter, rng, stats);
+                tomocam::write_zarr(vol, locs, 0, tomocam::next_output(dir, "patches", ".zarr").string(),
+                                    zarr_level);
+            } else {
+                auto locs = tomocam::sample_patches(vol, d.fov, per_slice, filter, rng, stats);
+                tomocam::write_patches(vol, locs, dir, 0, tiffOptions);
+            }
+            std::printf("%s: fov (%.1f, %.1f) r %.1f, %llu patches, %llu rejected, %llu missing\n",
+                        scan.c_str(), d.fov.cx, d.fov.cy, d.fov.r,
+                        static_cast<unsigned long long>(stats.accepted),
+                        static_cast<unsigned long long>(stats.rejected),
+                        static_cast<unsigned long long>(stats.missing));
+        } catch (const std::exception &e) {
+            std::fprintf(stderr, "%s: %s\n", scan.c_str(), e.what());
+            failed++;
+        }
+    }
+
+    // the segment name goes away with the ring, so let the consumer drain it
+    if (ring) {
+        ring->close();
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (!ring->finished() && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        if (!ring->finished()) {
+            std::fprintf(stderr, "%s: consumer did not drain the ring\n", ring_name.c_str());
+            failed++;
+        }
+    }
+    return failed ? 1 : 0;
+}
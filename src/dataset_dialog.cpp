@@ -0,0 +1,134 @@
+#include <QDialogButtonBox>
+#include <QFormLayout>
+#include <QHeaderView>
+#include <QLabel>
+#include <QPushButton>
+#include <QVBoxLayout>
+
+#include "dataset_dialog.h"
+
+namespace {
+    QString joinDims(const std::vector<hsize_t> &v) {
+        QStringList parts;
+        for (auto d : v)
+            parts << QString::number(d);
+        return parts.join(QString::fromUtf8(" × "));
+    }
+
+    QString humanBytes(uint64_t n) {
+        const char *units[] = {"B", "KB", "MB", "GB", "TB"};
+        double v = static_cast<double>(n);
+        int u = 0;
+        while (v >= 1024 && u < 4) {
+            v /= 1024;
+            u++;
+        }
+        return QString("%1 %2").arg(v, 0, 'f', u ? 1 : 0).arg(units[u]);
+    }
+} // namespace
+
+DatasetDialog::DatasetDialog(std::vector<tomocam::h5::DatasetInfo> sets,
+                             const std::string &preferred, QWidget *parent)
+    : QDialog(parent), sets_(std::move(sets)) {
+    setWindowTitle("Open HDF5 Dataset");
+
+    table = new QTableWidget(static_cast<int>(sets_.size()), 6, this);
+    table->setHorizontalHeaderLabels({"Dataset", "Shape", "Type", "Chunks", "Filters", "Size"});
+    table->horizontalHeader()->setSectionResizeMode(0, QHeaderView::Stretch);
+    table->setSelectionBehavior(QAbstractItemView::SelectRows);
+    table->setSelectionMode(QAbstractItemView::SingleSelection);
+    table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table->verticalHeader()->setVisible(false);
+
+    int pick = -1;
+    for (int i = 0; i < static_cast<int>(sets_.size()); i++) {
+        const auto &s = sets_[i];
+        QString filters = s.filters.empty() ? "-" : QString();
+        for (size_t f = 0; f < s.filters.size(); f++)
+            filters += (f ? ", " : "") + QString::fromStdString(s.filters[f]);
+        QString size = humanBytes(s.stored_bytes);
+        if (s.stored_bytes != s.bytes())
+            size += " (" + humanBytes(s.bytes()) + ")";
+        const QString cells[] = {QString::fromStdString(s.name), joinDims(s.dims),
+                                 QString::fromStdString(s.dtype),
+                                 s.chunks.empty() ? "contiguous" : joinDims(s.chunks), filters,
+                                 size};
+        bool volume = s.volume();
+        for (int c = 0; c < 6; c++) {
+            auto *item = new QTableWidgetItem(cells[c]);
+            // only numeric volumes can be shown
+            if (!volume)
+                item->setFlags(item->flags() & ~(Qt::ItemIsSelectable | Qt::ItemIsEnabled));
+            table->setItem(i, c, item);
+        }
+        if (volume && (pick < 0 || s.name == preferred))
+            pick = i;
+    }
+    table->resizeColumnsToContents();
+
+    firstSlice = new QSpinBox(this);
+    sliceCount = new QSpinBox(this);
+    connect(firstSlice, &QSpinBox::valueChanged, this, [this](int z0) {
+        int row = table->currentRow();
+        if (row >= 0)
+            sliceCount->setMaximum(static_cast<int>(sets_[row].dims[0]) - z0);
+    });
+    QFormLayout *range = new QFormLayout;
+    range->addRow("First slice", firstSlice);
+    range->addRow("Number of slices", sliceCount);
+
+    QDialogButtonBox *buttons =
+        new QDialogButtonBox(QDialogButtonBox::Open | QDialogButtonBox::Cancel, this);
+    okButton = buttons->button(QDialogButtonBox::Open);
+    connect(buttons, &QDialogButtonBox::accepted, this, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, this, &QDialog::reject);
+    connect(table, &QTableWidget::currentCellChanged, this,
+            [this](int row, int, int, int) { selectRow(row); });
+    connect(table, &QTableWidget::cellDoubleClicked, this, [this](int row, int) {
+        if (sets_[row].volume())
+            accept();
+    });
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(table);
+    layout->addLayout(range);
+    layout->addWidget(buttons);
+    resize(720, 360);
+
+    selectRow(pick);
+    if (pick >= 0)
+        table->setCurrentCell(pick, 0);
+}
+
+// show the slice range of the dataset in row, or disable opening
+void DatasetDialog::selectRow(int row) {
+    bool ok = row >= 0 && sets_[row].volume() && sets_[row].dims[0] > 0;
+    okButton->setEnabled(ok);
+    firstSlice->setEnabled(ok);
+    sliceCount->setEnabled(ok);
+    if (!ok)
+        return;
+    int nz = static_cast<int>(sets_[row].dims[0]);
+    firstSlice->setRange(0, nz - 1);
+    firstSlice->setValue(0);
+    sliceCount->setRange(1, nz);
+    sliceCount->setValue(nz);
+}
+
+std::string DatasetDialog::dataset() const { return sets_[table->currentRow()].name; }
+
+tomocam::dims_t DatasetDialog::dims() const {
+    const auto &d = sets_[table->currentRow()].dims;
+    return {static_cast<uint32_t>(d[0]), static_cast<uint32_t>(d[1]),
+            static_cast<uint32_t>(d[2])};
+}
+
+tomocam::Roi DatasetDialog::roi() const {
+    auto full = dims();
+    return tomocam::Roi{{static_cast<uint32_t>(firstSlice->value()), 0, 0},
+                        {static_cast<uint32_t>(sliceCount->value()), full.n1, full.n2}};
+}
+
+bool DatasetDialog::fullRange() const {
+    return firstSlice->value() == 0 && static_cast<uint32_t>(sliceCount->value()) == dims().n0;
+}
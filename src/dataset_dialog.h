@@ -0,0 +1,43 @@
+#include <QDialog>
+#include <QPushButton>
+#include <QSpinBox>
+#include <QTableWidget>
+#include <string>
+#include <vector>
+
+#include "io/array.h"
+#include "io/hdf5/reader.h"
+
+#ifndef DATASET_DIALOG__H
+#define DATASET_DIALOG__H
+
+/** pick a 3D dataset of an HDF5 file and the slices to load
+ * Built from metadata only, so nothing is read until the choice is made.
+ */
+class DatasetDialog : public QDialog {
+    Q_OBJECT
+
+  public:
+    /**
+     * @param sets datasets of the file, from h5::Reader::list()
+     * @param preferred dataset selected at first, if present and 3D
+     */
+    DatasetDialog(std::vector<tomocam::h5::DatasetInfo> sets, const std::string &preferred,
+                  QWidget *parent = nullptr);
+
+    std::string dataset() const;
+    tomocam::dims_t dims() const; // full shape of the chosen dataset
+    tomocam::Roi roi() const;     // chosen slices, all rows and columns
+    bool fullRange() const;
+
+  private:
+    void selectRow(int row);
+
+    std::vector<tomocam::h5::DatasetInfo> sets_;
+    QTableWidget *table;
+    QSpinBox *firstSlice;
+    QSpinBox *sliceCount;
+    QPushButton *okButton;
+};
+
+#endif // DATASET_DIALOG__H
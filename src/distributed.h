@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <mpi.h>
+
+#include "fov_detect.h"
+#include "patch_sampler.h"
+
+#ifndef DISTRIBUTED__H
+#define DISTRIBUTED__H
+
+namespace tomocam::dist {
+
+    struct Range {
+        uint32_t begin;
+        uint32_t end;
+        uint32_t size() const { return end - begin; }
+    };
+
+    /** contiguous share of n units (slices or slabs) for one rank; the
+     * first n % size ranks get one extra
+     */
+    inline Range split(uint32_t n, int rank, int size) {
+        uint32_t base = n / size;
+        uint32_t extra = n % size;
+        uint32_t r = static_cast<uint32_t>(rank);
+        uint32_t begin = r * base + std::min(r, extra);
+        return {begin, begin + base + (r < extra ? 1 : 0)};
+    }
+
+    /** random stream of one rank for one scan
+     * Streams depend only on (seed, rank, scan), so a run repeated with
+     * the same seed and number of ranks samples the same patches.
+     */
+    inline std::mt19937 rank_rng(uint32_t seed, int rank, uint32_t scan) {
+        std::seed_seq seq{seed, static_cast<uint32_t>(rank), scan};
+        return std::mt19937(seq);
+    }
+
+    /** combine the projections of each rank's slab into the projection of
+     * the whole volume, identical on every rank
+     * @param p projection of this rank's slab, empty slabs are fine
+     * @param nz slices in this rank's slab
+     */
+    inline void allreduce(Projection &p, uint32_t nz, MPI_Comm comm) {
+        int n = static_cast<int>(p.max.size());
+        MPI_Allreduce(MPI_IN_PLACE, p.max.data(), n, MPI_FLOAT, MPI_MAX, comm);
+
+        std::vector<double> sum(p.mean.size());
+        for (size_t i = 0; i < sum.size(); i++) sum[i] = nz ? double(p.mean[i]) * nz : 0.0;
+        MPI_Allreduce(MPI_IN_PLACE, sum.data(), n, MPI_DOUBLE, MPI_SUM, comm);
+        uint64_t total = nz;
+        MPI_Allreduce(MPI_IN_PLACE, &total, 1, MPI_UINT64_T, MPI_SUM, comm);
+        for (size_t i = 0; i < sum.size(); i++)
+            p.mean[i] = static_cast<float>(sum[i] / std::max<uint64_t>(total, 1));
+    }
+
+    /** place of this rank's items in a collective append
+     * @return {items of lower ranks, items of all ranks}
+     */
+    inline std::pair<uint64_t, uint64_t> offsets(uint64_t n, MPI_Comm comm) {
+        uint64_t before = 0, total = 0;
+        MPI_Exscan(&n, &before, 1, MPI_UINT64_T, MPI_SUM, comm);
+        MPI_Allreduce(&n, &total, 1, MPI_UINT64_T, MPI_SUM, comm);
+        int rank;
+        MPI_Comm_rank(comm, &rank);
+        if (rank == 0) before = 0; // MPI_Exscan leaves rank 0 undefined
+        return {before, total};
+    }
+
+    // totals over all ranks
+    inline SampleStats allreduce(const SampleStats &s, MPI_Comm comm) {
+        uint64_t v[3] = {s.accepted, s.rejected, s.missing};
+        MPI_Allreduce(MPI_IN_PLACE, v, 3, MPI_UINT64_T, MPI_SUM, comm);
+        return {v[0], v[1], v[2]};
+    }
+
+    // true on every rank if ok on all of them, so ranks leave collectives together
+    inline bool all(bool ok, MPI_Comm comm) {
+        int v = ok ? 1 : 0;
+        MPI_Allreduce(MPI_IN_PLACE, &v, 1, MPI_INT, MPI_MIN, comm);
+        return v != 0;
+    }
+} // namespace tomocam::dist
+#endif // DISTRIBUTED__H
@@ -0,0 +1,336 @@
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fov_detect.h"
+#include "io/array.h"
+#include "io/loader.h"
+#include "io/tiff/tiffio.h"
+#include "io/trace.h"
+#include "patch_sampler.h"
+#include "save_patch.h"
+#include "volume_export.h"
+
+#ifndef EXPORT_QUEUE__H
+#define EXPORT_QUEUE__H
+
+namespace tomocam {
+
+    // everything needed to export one scan without the viewer
+    struct ExportJob {
+        std::string filename;
+        std::string dataset;        // HDF5 dataset, empty for the default
+        Roi roi;                    // region to load, default all
+        std::vector<uint64_t> ifds; // tiff page index, may be empty
+        Circle fov{0, 0, 0};        // in roi coordinates
+        bool detect = false;        // detect the field of view after loading
+        std::filesystem::path outdir;
+        int per_slice = 1;
+        uint32_t depth = 0;         // > 0 writes sub-volumes to volumes_NNN.h5
+        tiff::WriteOptions tiff;
+        QualityFilter filter;
+        uint32_t seed = 0;
+    };
+
+    enum class JobState { Queued, Loading, Loaded, Exporting, Done, Failed, Cancelled };
+
+    inline const char *to_string(JobState s) {
+        switch (s) {
+        case JobState::Queued:
+            return "queued";
+        case JobState::Loading:
+            return "loading";
+        case JobState::Loaded:
+            return "loaded";
+        case JobState::Exporting:
+            return "exporting";
+        case JobState::Done:
+            return "done";
+        case JobState::Failed:
+            return "failed";
+        default:
+            return "cancelled";
+        }
+    }
+
+    struct JobStatus {
+        uint64_t id;
+        std::string filename;
+        JobState state;
+        double progress;  // export fraction, 0 to 1
+        SampleStats stats;
+        std::string error;
+    };
+
+    /** background export of many scans
+     * A loader thread reads the next scan while an exporter thread writes
+     * the current one, so reads and writes overlap across jobs. At most
+     * prefetch loaded scans wait for the exporter, which bounds memory to
+     * prefetch + 1 volumes. Sub-volume jobs on HDF5 scans are not loaded
+     * at all: the exporter reads them from the file one slab at a time.
+     * Jobs can be cancelled while queued, loaded,
+     * loading or exporting; a load stops after the slab in flight, an
+     * export after the patch or slab in flight, and files already written
+     * are kept. Destroying the queue cancels everything the same way.
+     */
+    class ExportQueue {
+      private:
+        struct Loaded {
+            uint64_t id;
+            ExportJob job;
+            Array<float> vol;
+        };
+
+        mutable std::mutex mtx_;
+        std::condition_variable cv_;
+        std::deque<std::pair<uint64_t, ExportJob>> pending_;
+        std::deque<Loaded> ready_;
+        std::map<uint64_t, JobStatus> status_;
+        std::set<uint64_t> cancelled_;
+        size_t prefetch_;
+        size_t busy_;
+        uint64_t next_id_;
+        bool stop_;
+        std::thread loader_;
+        std::thread exporter_;
+
+        // caller holds mtx_
+        bool is_cancelled(uint64_t id) const { return stop_ || cancelled_.count(id); }
+
+        // sub-volumes of an HDF5 scan are cut straight from the file, one
+        // slab at a time, so the whole volume is never loaded
+        static bool streams(const ExportJob &job) {
+            return job.depth > 0 && std::filesystem::path(job.filename).extension() == ".h5";
+        }
+
+        void finish(uint64_t id, JobState state, std::string error = {}) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            auto &st = status_[id];
+            st.state = state;
+            st.error = std::move(error);
+            busy_--;
+            cv_.notify_all();
+        }
+
+        void load_loop() {
+            while (true) {
+                std::pair<uint64_t, ExportJob> next;
+                {
+                    std::unique_lock<std::mutex> lock(mtx_);
+                    cv_.wait(lock, [this] {
+                        return stop_ || (!pending_.empty() && ready_.size() < prefetch_);
+                    });
+                    if (stop_) return;
+                    next = std::move(pending_.front());
+                    pending_.pop_front();
+                    status_[next.first].state = JobState::Loading;
+                    busy_++;
+                }
+
+                // a cancelled job or a closing queue stops the read at the
+                // next slab instead of waiting for the whole volume
+                auto keep_reading = [this, id = next.first](double) {
+                    std::lock_guard<std::mutex> lock(mtx_);
+                    return !is_cancelled(id);
+                };
+                Array<float> vol;
+                try {
+                    const ExportJob &job = next.second;
+                    if (!streams(job))
+                        vol = loader(job.filename, job.roi, job.ifds, job.dataset, keep_reading);
+                } catch (const std::exception &e) {
+                    finish(next.first, JobState::Failed, e.what());
+                    continue;
+                }
+
+                std::lock_guard<std::mutex> lock(mtx_);
+                if (is_cancelled(next.first)) {
+                    status_[next.first].state = JobState::Cancelled;
+                    busy_--;
+                } else {
+                    status_[next.first].state = JobState::Loaded;
+                    ready_.push_back({next.first, std::move(next.second), std::move(vol)});
+                }
+                cv_.notify_all();
+            }
+        }
+
+        void export_loop() {
+            while (true) {
+                Loaded cur;
+                {
+                    std::unique_lock<std::mutex> lock(mtx_);
+                    cv_.wait(lock, [this] { return stop_ || !ready_.empty(); });
+                    if (stop_) return;
+                    cur = std::move(ready_.front());
+                    ready_.pop_front();
+                    status_[cur.id].state = JobState::Exporting;
+                    cv_.notify_all(); // room for the loader to read ahead
+                }
+
+                try {
+                    bool done = run(cur);
+                    finish(cur.id, done ? JobState::Done : JobState::Cancelled);
+                } catch (const std::exception &e) {
+                    finish(cur.id, JobState::Failed, e.what());
+                }
+            }
+        }
+
+        // export one loaded scan, false if it was cancelled part way
+        bool run(Loaded &cur) {
+            TOMOCAM_TRACE_SCOPE("export_job", "export");
+            const ExportJob &job = cur.job;
+            std::unique_ptr<h5::Reader> reader; // set when the job streams
+            std::string name;
+            if (streams(job)) {
+                reader = std::make_unique<h5::Reader>(job.filename.c_str());
+                if (!reader->valid()) throw std::runtime_error("cannot open " + job.filename);
+                name = job.dataset.empty() ? default_dataset(*reader) : job.dataset;
+            }
+
+            Circle fov = job.fov;
+            if (job.detect) {
+                auto d = reader ? detect_fov(*reader, name.c_str(), job.roi) : detect_fov(cur.vol);
+                if (!d.ok) throw std::runtime_error("field of view not found");
+                fov = d.fov;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                if (is_cancelled(cur.id)) return false;
+            }
+
+            bool keep_going = true;
+            auto progress = [this, id = cur.id, &keep_going](double p) {
+                std::lock_guard<std::mutex> lock(mtx_);
+                status_[id].progress = p;
+                keep_going = !is_cancelled(id);
+                return keep_going;
+            };
+
+            std::filesystem::create_directories(job.outdir);
+            std::mt19937 gen(job.seed);
+            SampleStats stats;
+            if (job.depth > 0) {
+                VolumeExport opts;
+                opts.filename = next_output(job.outdir, "volumes", ".h5").string();
+                opts.depth = job.depth;
+                opts.per_slab = job.per_slice;
+                stats = reader ? export_volumes<float>(*reader, name.c_str(), job.roi, fov, opts,
+                                     job.filter, gen, progress)
+                               : export_volumes(cur.vol, fov, opts, job.filter, gen, progress);
+            } else {
+                auto locs = sample_patches(cur.vol, fov, job.per_slice, job.filter, gen, stats);
+                write_patches(cur.vol, locs, job.outdir, next_patch_index(job.outdir), job.tiff,
+                    progress);
+            }
+
+            std::lock_guard<std::mutex> lock(mtx_);
+            status_[cur.id].stats = stats;
+            return keep_going;
+        }
+
+      public:
+        /**
+         * @param prefetch loaded scans allowed to wait for the exporter
+         */
+        ExportQueue(size_t prefetch = 1) :
+            prefetch_(std::max<size_t>(1, prefetch)), busy_(0), next_id_(1), stop_(false) {
+            loader_ = std::thread([this] { load_loop(); });
+            exporter_ = std::thread([this] { export_loop(); });
+        }
+
+        // cancels whatever is still queued or running
+        ~ExportQueue() {
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                stop_ = true;
+            }
+            cv_.notify_all();
+            loader_.join();
+            exporter_.join();
+        }
+
+        ExportQueue(const ExportQueue &) = delete;
+        ExportQueue &operator=(const ExportQueue &) = delete;
+
+        // @return job id
+        uint64_t submit(ExportJob job) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            uint64_t id = next_id_++;
+            status_[id] = JobStatus{id, job.filename, JobState::Queued, 0.0, {}, {}};
+            pending_.emplace_back(id, std::move(job));
+            cv_.notify_all();
+            return id;
+        }
+
+        /** cancel a job; queued and loaded jobs are dropped at once
+         * @return false if the job is unknown or already finished
+         */
+        bool cancel(uint64_t id) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            auto it = status_.find(id);
+            if (it == status_.end()) return false;
+            JobState s = it->second.state;
+            if (s == JobState::Done || s == JobState::Failed || s == JobState::Cancelled)
+                return false;
+
+            cancelled_.insert(id);
+            auto drop = [&](auto &q, auto key) {
+                for (auto j = q.begin(); j != q.end(); ++j) {
+                    if (key(*j) == id) {
+                        q.erase(j);
+                        it->second.state = JobState::Cancelled;
+                        return true;
+                    }
+                }
+                return false;
+            };
+            if (drop(pending_, [](auto &e) { return e.first; })) return true;
+            if (drop(ready_, [](auto &e) { return e.id; })) {
+                busy_--;
+                cv_.notify_all();
+            }
+            return true;
+        }
+
+        // status of every job submitted so far, in submission order
+        std::vector<JobStatus> snapshot() const {
+            std::lock_guard<std::mutex> lock(mtx_);
+            std::vector<JobStatus> v;
+            v.reserve(status_.size());
+            for (auto &kv : status_) v.push_back(kv.second);
+            return v;
+        }
+
+        // forget finished jobs
+        void clear_finished() {
+            std::lock_guard<std::mutex> lock(mtx_);
+            for (auto it = status_.begin(); it != status_.end();) {
+                JobState s = it->second.state;
+                bool over = s == JobState::Done || s == JobState::Failed || s == JobState::Cancelled;
+                if (over) cancelled_.erase(it->first);
+                it = over ? status_.erase(it) : std::next(it);
+            }
+        }
+
+        // block until every submitted job has finished
+        void wait() {
+            std::unique_lock<std::mutex> lock(mtx_);
+            cv_.wait(lock, [this] { return pending_.empty() && ready_.empty() && busy_ == 0; });
+        }
+    };
+} // namespace tomocam
+#endif // EXPORT_QUEUE__H
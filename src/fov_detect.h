@@ -0,0 +1,328 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "io/array.h"
+#include "io/hdf5/reader.h"
+#include "io/trace.h"
+#include "patch_sampler.h"
+
+#ifndef FOV_DETECT__H
+#define FOV_DETECT__H
+
+namespace tomocam {
+
+    // per-pixel maximum and mean over all slices of a volume
+    struct Projection {
+        uint32_t nrows = 0;
+        uint32_t ncols = 0;
+        std::vector<float> max;
+        std::vector<float> mean;
+
+        Slice<float> max_slice() { return {nrows, ncols, max.data()}; }
+        Slice<float> mean_slice() { return {nrows, ncols, mean.data()}; }
+    };
+
+    /** max and mean intensity projections along the slice axis in one pass
+     * Threads own blocks of rows and stream every slice through them, so
+     * each voxel is read once, contiguously, and no partials are merged.
+     */
+    template <typename T>
+    Projection project(const Array<T> &vol) {
+        TOMOCAM_TRACE_SCOPE("project", "detect");
+        Projection p;
+        p.nrows = vol.nrows();
+        p.ncols = vol.ncols();
+        size_t plane = size_t(p.nrows) * p.ncols;
+        p.max.resize(plane);
+        p.mean.resize(plane);
+        uint32_t nz = vol.nslices();
+
+#pragma omp parallel
+        {
+            std::vector<double> sum(p.ncols);
+#pragma omp for schedule(static)
+            for (int64_t j = 0; j < int64_t(p.nrows); j++) {
+                float *mx = p.max.data() + j * p.ncols;
+                std::fill(sum.begin(), sum.end(), 0.0);
+                std::fill_n(mx, p.ncols, -INFINITY);
+                for (uint32_t z = 0; z < nz; z++) {
+                    const T *src = vol.begin() + vol.flatIdx(z, j, 0);
+#pragma omp simd
+                    for (uint32_t k = 0; k < p.ncols; k++) {
+                        float v = static_cast<float>(src[k]);
+                        mx[k] = std::max(mx[k], v);
+                        sum[k] += v;
+                    }
+                }
+                float *mn = p.mean.data() + j * p.ncols;
+                for (uint32_t k = 0; k < p.ncols; k++)
+                    mn[k] = static_cast<float>(sum[k] / nz);
+            }
+        }
+        return p;
+    }
+
+    /** max and mean projections of a volume read slab by slab, for
+     * volumes that do not fit in memory; add() every slab, then finish()
+     */
+    class Projector {
+      private:
+        Projection p_;
+        std::vector<double> sum_;
+        uint64_t nz_ = 0;
+
+      public:
+        Projector(uint32_t nrows, uint32_t ncols) : sum_(size_t(nrows) * ncols, 0.0) {
+            p_.nrows = nrows;
+            p_.ncols = ncols;
+            p_.max.assign(sum_.size(), -INFINITY);
+        }
+
+        template <typename T>
+        void add(const Array<T> &slab) {
+            if (slab.nrows() != p_.nrows || slab.ncols() != p_.ncols)
+                throw std::runtime_error("slab does not match the projection");
+#pragma omp parallel for schedule(static)
+            for (int64_t j = 0; j < int64_t(p_.nrows); j++) {
+                float *mx = p_.max.data() + j * p_.ncols;
+                double *sum = sum_.data() + j * p_.ncols;
+                for (uint32_t z = 0; z < slab.nslices(); z++) {
+                    const T *src = slab.begin() + slab.flatIdx(z, j, 0);
+#pragma omp simd
+                    for (uint32_t k = 0; k < p_.ncols; k++) {
+                        float v = static_cast<float>(src[k]);
+                        mx[k] = std::max(mx[k], v);
+                        sum[k] += v;
+                    }
+                }
+            }
+            nz_ += slab.nslices();
+        }
+
+        Projection finish() {
+            p_.mean.resize(sum_.size());
+            double n = std::max<uint64_t>(nz_, 1);
+            for (size_t i = 0; i < sum_.size(); i++) p_.mean[i] = static_cast<float>(sum_[i] / n);
+            return std::move(p_);
+        }
+    };
+
+    struct DetectOptions {
+        bool use_max = true;     // fit the max projection, else the mean
+        double threshold = NAN;  // foreground level, NaN to use the corners
+        int iterations = 10;     // reweighting rounds of the robust fit
+        double min_inliers = 0.5; // fraction of edge points within tolerance
+    };
+
+    struct Detection {
+        Circle fov{0, 0, 0};
+        size_t edge_points = 0;
+        double inliers = 0; // fraction of edge points within 2 px of the circle
+        bool ok = false;
+    };
+
+    namespace detail {
+        /** background band from the four corners of the projection, which
+         * lie outside an inscribed field of view: median +/- 6 robust
+         * standard deviations (MAD), at least a relative epsilon wide
+         * @return {lo, hi}, pixels outside the band are foreground
+         */
+        inline std::pair<double, double> corner_band(const Slice<float> &img) {
+            uint32_t b = std::max(4u, std::min(img.nrows, img.ncols) / 16);
+            b = std::min({b, img.nrows, img.ncols});
+            std::vector<float> v;
+            v.reserve(4 * size_t(b) * b);
+            for (uint32_t j = 0; j < b; j++) {
+                for (uint32_t k = 0; k < b; k++) {
+                    for (uint32_t y : {j, img.nrows - 1 - j})
+                        for (uint32_t x : {k, img.ncols - 1 - k})
+                            v.push_back(img.ptr[size_t(y) * img.ncols + x]);
+                }
+            }
+            auto median = [](std::vector<float> &a) {
+                auto mid = a.begin() + a.size() / 2;
+                std::nth_element(a.begin(), mid, a.end());
+                return static_cast<double>(*mid);
+            };
+            double med = median(v);
+            for (auto &x : v) x = std::fabs(x - med);
+            double delta = 6 * 1.4826 * median(v);
+            delta = std::max(delta, 1e-6 * std::max(1.0, std::fabs(med)));
+            return {med - delta, med + delta};
+        }
+
+        /** foreground pixels with a background 4-neighbour, in row order
+         * Pixels on the image border are skipped: a field of view larger
+         * than the slice is cut there, which is not its rim.
+         * @param lo, hi background band, pixels outside it are foreground
+         */
+        inline std::vector<std::pair<float, float>> edge_points(
+            const Slice<float> &img, double lo, double hi) {
+            uint32_t ny = img.nrows;
+            uint32_t nx = img.ncols;
+            std::vector<std::vector<std::pair<float, float>>> rows(ny);
+            auto fg = [&](uint32_t j, uint32_t k) {
+                float v = img.ptr[size_t(j) * nx + k];
+                return v < lo || v > hi;
+            };
+#pragma omp parallel for schedule(static)
+            for (int64_t j = 1; j < int64_t(ny) - 1; j++) {
+                for (uint32_t k = 1; k + 1 < nx; k++) {
+                    if (fg(j, k) && !(fg(j - 1, k) && fg(j + 1, k) &&
+                                        fg(j, k - 1) && fg(j, k + 1)))
+                        rows[j].emplace_back(float(k), float(j));
+                }
+            }
+            std::vector<std::pair<float, float>> pts;
+            for (auto &r : rows) pts.insert(pts.end(), r.begin(), r.end());
+            return pts;
+        }
+
+        /** weighted algebraic (Kasa) fit: x^2 + y^2 + D x + E y + F = 0
+         * Points are centred first to keep the normal equations well
+         * conditioned.
+         */
+        inline bool kasa_fit(const std::vector<std::pair<float, float>> &pts,
+            const std::vector<double> &w, Circle &c) {
+            double sw = 0, mx = 0, my = 0;
+            for (size_t i = 0; i < pts.size(); i++) {
+                sw += w[i];
+                mx += w[i] * pts[i].first;
+                my += w[i] * pts[i].second;
+            }
+            if (sw <= 0) return false;
+            mx /= sw;
+            my /= sw;
+
+            // A^T W A and A^T W b with rows [x, y, 1] and b = -(x^2 + y^2)
+            double a[3][4] = {};
+            for (size_t i = 0; i < pts.size(); i++) {
+                double x = pts[i].first - mx;
+                double y = pts[i].second - my;
+                double row[3] = {x, y, 1.0};
+                double b = -(x * x + y * y);
+                for (int r = 0; r < 3; r++) {
+                    for (int s = 0; s < 3; s++) a[r][s] += w[i] * row[r] * row[s];
+                    a[r][3] += w[i] * row[r] * b;
+                }
+            }
+            // Gauss-Jordan with partial pivoting
+            for (int col = 0; col < 3; col++) {
+                int piv = col;
+                for (int r = col + 1; r < 3; r++)
+                    if (std::fabs(a[r][col]) > std::fabs(a[piv][col])) piv = r;
+                if (std::fabs(a[piv][col]) < 1e-12) return false;
+                std::swap(a[col], a[piv]);
+                for (int r = 0; r < 3; r++) {
+                    if (r == col) continue;
+                    double f = a[r][col] / a[col][col];
+                    for (int s = col; s < 4; s++) a[r][s] -= f * a[col][s];
+                }
+            }
+            double D = a[0][3] / a[0][0];
+            double E = a[1][3] / a[1][1];
+            double F = a[2][3] / a[2][2];
+            double r2 = 0.25 * (D * D + E * E) - F;
+            if (!(r2 > 0)) return false;
+            c = {static_cast<float>(mx - 0.5 * D), static_cast<float>(my - 0.5 * E),
+                static_cast<float>(std::sqrt(r2))};
+            return true;
+        }
+    } // namespace detail
+
+    /** fit the reconstruction field of view to a projection
+     * Pixels that differ from the background (estimated in the image
+     * corners, or below an explicit threshold) are foreground; the rim of
+     * the foreground is traced and a circle is fitted to it with
+     * iteratively reweighted least squares (Tukey biweight, MAD scale), so
+     * edges of the sample itself are down-weighted rather than pulling the
+     * fit.
+     * @param img max or mean projection
+     * @param opts threshold and fit settings
+     */
+    inline Detection fit_fov(const Slice<float> &img, const DetectOptions &opts = {}) {
+        TOMOCAM_TRACE_SCOPE("fit_fov", "detect");
+        Detection d;
+        auto band = std::isnan(opts.threshold)
+                        ? detail::corner_band(img)
+                        : std::make_pair(-HUGE_VAL, opts.threshold);
+        auto pts = detail::edge_points(img, band.first, band.second);
+        d.edge_points = pts.size();
+        if (pts.size() < 3) return d;
+
+        std::vector<double> w(pts.size(), 1.0);
+        std::vector<double> res(pts.size());
+        Circle c;
+        if (!detail::kasa_fit(pts, w, c)) return d;
+        auto residuals = [&](const Circle &c) {
+            for (size_t i = 0; i < pts.size(); i++)
+                res[i] = std::hypot(pts[i].first - c.cx, pts[i].second - c.cy) - c.r;
+        };
+
+        for (int it = 0; it < opts.iterations; it++) {
+            residuals(c);
+            std::vector<double> absr(res.size());
+            for (size_t i = 0; i < res.size(); i++) absr[i] = std::fabs(res[i]);
+            auto mid = absr.begin() + absr.size() / 2;
+            std::nth_element(absr.begin(), mid, absr.end());
+            double scale = std::max(1.4826 * *mid, 1.0); // at least a pixel
+            double cut = 4.685 * scale;
+            for (size_t i = 0; i < res.size(); i++) {
+                double u = res[i] / cut;
+                w[i] = (std::fabs(u) < 1) ? (1 - u * u) * (1 - u * u) : 0.0;
+            }
+            if (!detail::kasa_fit(pts, w, c)) return d;
+        }
+
+        residuals(c);
+        size_t in = 0;
+        for (double r : res) in += (std::fabs(r) <= 2.0);
+        d.fov = c;
+        d.inliers = double(in) / pts.size();
+        d.ok = d.inliers >= opts.min_inliers;
+        return d;
+    }
+
+    /** detect the field of view of a reconstructed volume
+     * @param vol volume, or a slab of it
+     * @param opts projection choice, threshold and fit settings
+     */
+    template <typename T>
+    Detection detect_fov(const Array<T> &vol, const DetectOptions &opts = {}) {
+        TOMOCAM_TRACE_SCOPE("detect_fov", "detect");
+        auto p = project(vol);
+        return fit_fov(opts.use_max ? p.max_slice() : p.mean_slice(), opts);
+    }
+
+    /** detect the field of view of an HDF5 volume without loading it; the
+     * projections are built from slabs of about READ_SLAB_BYTES
+     * @param reader open input file
+     * @param dataset 3D dataset name
+     * @param roi block of the dataset, zero count for all; the result is in
+     * its coordinates
+     */
+    inline Detection detect_fov(h5::Reader &reader, const char *dataset, const Roi &roi,
+        const DetectOptions &opts = {}) {
+        TOMOCAM_TRACE_SCOPE("detect_fov", "detect");
+        auto info = reader.info(dataset);
+        if (info.dims.size() != 3) throw std::runtime_error("Data is not 3D");
+        Roi r = roi.clip(dims_t{uint32_t(info.dims[0]), uint32_t(info.dims[1]), uint32_t(info.dims[2])});
+        uint64_t slice = uint64_t(r.count.n1) * r.count.n2 * sizeof(float);
+        uint32_t step = static_cast<uint32_t>(
+            std::clamp<uint64_t>(h5::READ_SLAB_BYTES / std::max<uint64_t>(slice, 1), 1, r.count.n0));
+
+        Projector proj(r.count.n1, r.count.n2);
+        for (uint32_t z = 0; z < r.count.n0; z += step) {
+            uint32_t n = std::min(step, r.count.n0 - z);
+            proj.add(reader.read_roi<float>(dataset,
+                Roi{{r.start.n0 + z, r.start.n1, r.start.n2}, {n, r.count.n1, r.count.n2}}));
+        }
+        auto p = proj.finish();
+        return fit_fov(opts.use_max ? p.max_slice() : p.mean_slice(), opts);
+    }
+} // namespace tomocam
+#endif // FOV_DETECT__H
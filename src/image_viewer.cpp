@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <cstdint>
 #include <cstdlib>
+#include <future>
 #include <qevent.h>
 #include <qgraphicsview.h>
 #include <qnamespace.h>
@@ -10,16 +11,24 @@
 
 #include "image_viewer.h"
 #include "io/tiff/tiffio.h"
+#include "io/trace.h"
 #include "main_window.h"
+#include "patch_sampler.h"
+#include "qimage_utils.h"
 #include "save_patch.h"
 
 constexpr int PATCHES_PER_FRAME = 1;
-
-template <typename T> T random() { return static_cast<T>(rand()) / static_cast<T>(RAND_MAX); }
+// resident 8-bit display slices, shared by rendering and prefetch
+constexpr uint64_t DISPLAY_CACHE_BYTES = 256ull << 20;
+// slices converted ahead of the scroll direction
+constexpr int PREFETCH_AHEAD = 4;
 
 ImageViewer::ImageViewer(const tomocam::Array<float> &images, QWidget *parent)
-    : QGraphicsView(parent), imageStack(images), currentIndex(0), counter(0), save_roi_flag(false),
-      pickedCenter(false), pickedRadius(false), pickMode(PickMode::None), scaleH(1.f), scaleW(1.f) {
+    : QGraphicsView(parent), imageStack(images), previewDims{0, 0, 0}, previewing(false),
+      currentIndex(0), step(1), save_roi_flag(false),
+      pickedCenter(false), pickedRadius(false), pickMode(PickMode::None), scaleH(1.f), scaleW(1.f),
+      realCenX(0.f), realCenY(0.f), realRmax(0.f),
+      rng(std::random_device{}()), displayCache(DISPLAY_CACHE_BYTES), stackId(0) {
 
     scene = new QGraphicsScene(this);
     setScene(scene);
@@ -28,69 +37,128 @@ ImageViewer::ImageViewer(const tomocam::Array<float> &images, QWidget *parent)
     updateImage();
 }
 
+ImageViewer::~ImageViewer() { stopPrefetch(); }
+
 void ImageViewer::updateImage() {
+    TOMOCAM_TRACE_SCOPE("updateImage", "render");
+    auto t0 = tomocam::trace::clock::now();
+
     scene->clear();
-    QImage img = floatArrayToQImage(imageStack.slice(currentIndex));
-    scene->addPixmap(QPixmap::fromImage(img));
-    scene->setSceneRect(img.rect());
-}
-
-QImage ImageViewer::floatArrayToQImage(const tomocam::Slice<float> &array) {
-    int h = array.nrows;
-    int w = array.ncols;
-
-    // Find min/max for normalization
-    minVal = array[0];
-    maxVal = array[0];
-    for (uint32_t y = 0; y < h; ++y) {
-        for (uint32_t x = 0; x < w; ++x) {
-            minVal = std::min(minVal, array[y * w + x]);
-            maxVal = std::max(maxVal, array[y * w + x]);
+    QImage img;
+    tomocam::SliceCache<uint8_t>::Handle pinned; // img may point into it until uploaded
+    {
+        TOMOCAM_TRACE_SCOPE("convert", "render");
+        if (previewing) {
+            img = fitToWindow(grayscaleQImage(previewStack.slice(currentIndex)), previewDims.n1,
+                              previewDims.n2);
+        } else if (imageStack.size() > 0) {
+            pinned = displaySlice(stackId, currentIndex);
+            auto v = pinned.view();
+            QImage gray(v.ptr, v.ncols, v.nrows, v.stride, QImage::Format_Grayscale8);
+            img = fitToWindow(gray, v.nrows, v.ncols);
         }
     }
+    {
+        TOMOCAM_TRACE_SCOPE("upload", "render");
+        scene->addPixmap(QPixmap::fromImage(img));
+        scene->setSceneRect(img.rect());
+    }
+    pinned.reset();
+    prefetch();
+
+    auto &metrics = tomocam::trace::Metrics::instance();
+    metrics.frames++;
+    metrics.frame_us = tomocam::trace::elapsed_us(t0);
+}
 
-    QImage img(w, h, QImage::Format_Grayscale8);
-    for (int y = 0; y < h; ++y) {
-        uchar *line = img.scanLine(y);
-        for (int x = 0; x < w; ++x) {
-            float norm = (array[y * w + x] - minVal) / (maxVal - minVal);
-            line[x] = static_cast<uchar>(norm * 255.0f);
+// slice i of imageStack as shown, converted on first use
+tomocam::SliceCache<uint8_t>::Handle ImageViewer::displaySlice(uint64_t id, int i) {
+    auto fill = [this, i](tomocam::Slice<uint8_t> dst) {
+        auto src = imageStack.slice(i);
+        if (static_cast<size_t>(i) < sliceStats.size()) {
+            toGrayscale(src, dst, sliceStats[i].min, sliceStats[i].max);
+        } else {
+            auto mm = tomocam::reduce::minmax(src);
+            toGrayscale(src, dst, mm.min, mm.max);
         }
+    };
+    return displayCache.get({id, static_cast<uint32_t>(i)}, imageStack.nrows(),
+                            imageStack.ncols(), fill);
+}
+
+// convert the next slices in the scroll direction in the background
+void ImageViewer::prefetch() {
+    if (previewing || imageStack.size() == 0)
+        return;
+    prefetches.erase(std::remove_if(prefetches.begin(), prefetches.end(),
+                                    [](const std::future<void> &f) {
+                                        return f.wait_for(std::chrono::seconds(0)) ==
+                                               std::future_status::ready;
+                                    }),
+                     prefetches.end());
+    if (prefetches.size() >= static_cast<size_t>(PREFETCH_AHEAD))
+        return;
+
+    int n = nslices();
+    uint64_t id = stackId;
+    for (int k = 1; k <= PREFETCH_AHEAD; k++) {
+        int i = ((currentIndex + k * step) % n + n) % n;
+        if (displayCache.contains({id, static_cast<uint32_t>(i)}))
+            continue;
+        prefetches.push_back(prefetchPool.submit([this, id, i]() {
+            // a queued slice of a replaced stack is not read at all
+            if (stackId == id)
+                displaySlice(id, i);
+        }));
     }
+}
+
+// retire the current stackId: queued prefetches are skipped, running ones
+// finish before imageStack or sliceStats change, and its slices are freed
+void ImageViewer::stopPrefetch() {
+    uint64_t old = stackId++;
+    for (auto &f : prefetches)
+        f.wait();
+    prefetches.clear();
+    displayCache.drop(old);
+}
+
+// scale an image of an h x w slice to the window, a smaller image (preview)
+// is stretched to the size the full slice would be shown at
+QImage ImageViewer::fitToWindow(const QImage &img, int h, int w) {
     // resize of image is too big
     // get main window
-    MainWindow *mainWin;
+    MainWindow *mainWin = nullptr;
     QWidget *curr_parent = this->parentWidget();
     while (curr_parent) {
         mainWin = qobject_cast<MainWindow *>(curr_parent);
         if (mainWin) {
             break;
         }
+        curr_parent = curr_parent->parentWidget();
     }
+    scaleH = 1.f;
+    scaleW = 1.f;
     if (mainWin) {
         if (h > mainWin->maxHeight() || w > mainWin->maxWidth()) {
-            img = img.scaled(mainWin->maxWidth(), mainWin->maxHeight(),
-                             Qt::KeepAspectRatioByExpanding);
             scaleH = static_cast<float>(h) / static_cast<float>(mainWin->maxHeight());
             scaleW = static_cast<float>(w) / static_cast<float>(mainWin->maxWidth());
+            return img.scaled(mainWin->maxWidth(), mainWin->maxHeight(),
+                              Qt::KeepAspectRatioByExpanding);
         }
     }
+    if (img.height() != h || img.width() != w)
+        return img.scaled(w, h, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
     return img;
 }
 
 void ImageViewer::wheelEvent(QWheelEvent *event) {
-    auto nImgs = imageStack.nslices();
+    auto nImgs = nslices();
 
-    int step = 1;
-    if (event->modifiers() & Qt::ControlModifier) {
-        step = 5;
-    }
-
-    if (event->angleDelta().y() > 0) {
-        currentIndex = (currentIndex + step) % nImgs;
-    } else {
-        currentIndex = (currentIndex - step + nImgs) % nImgs;
-    }
+    step = (event->modifiers() & Qt::ControlModifier) ? 5 : 1;
+    if (event->angleDelta().y() <= 0)
+        step = -step;
+    currentIndex = ((currentIndex + step) % nImgs + nImgs) % nImgs;
     updateImage();
 }
 
@@ -100,7 +168,7 @@ void ImageViewer::mousePressEvent(QMouseEvent *event) {
     int x = static_cast<int>(scenePos.x());
     int y = static_cast<int>(scenePos.y());
 
-    if (imageStack.size() > 0 && x >= 0 && y >= 0 && y < static_cast<int>(imageStack.nrows()) &&
+    if (!previewing && imageStack.size() > 0 && x >= 0 && y >= 0 && y < static_cast<int>(imageStack.nrows()) &&
         x < static_cast<int>(imageStack.ncols())) {
         if (pickMode == PickMode::PickP1) {
             center = QPoint(x, y);
@@ -114,39 +182,75 @@ void ImageViewer::mousePressEvent(QMouseEvent *event) {
             pickMode = PickMode::None;
         }
         if (pickedCenter && pickedRadius) {
+            realCenX = scaleW * center.x();
+            realCenY = scaleH * center.y();
+            realRmax = std::sqrt(std::pow(scaleW * (radius.x() - center.x()), 2) +
+                                 std::pow(scaleH * (radius.y() - center.y()), 2));
             emit picksCompleted(center, radius);
         }
     }
     QGraphicsView::mousePressEvent(event);
 }
 
-void ImageViewer::updateImageStack(const tomocam::Array<float> &arr) {
-    imageStack = arr;
+void ImageViewer::updateImageStack(const tomocam::Array<float> &arr, bool keepIndex) {
+    updateImageStack(tomocam::Array<float>(arr), keepIndex);
+}
+
+void ImageViewer::updateImageStack(tomocam::Array<float> &&arr, bool keepIndex) {
+    stopPrefetch();
+    imageStack = std::move(arr);
+    previewStack = tomocam::Array<uint8_t>();
+    previewing = false;
+    sliceStats.clear();
+    if (!keepIndex || currentIndex >= static_cast<int>(imageStack.nslices()))
+        currentIndex = 0;
+    updateImage();
+}
+
+void ImageViewer::showPreview(tomocam::Array<uint8_t> &&arr, tomocam::dims_t full) {
+    stopPrefetch();
+    previewStack = std::move(arr);
+    previewDims = full;
+    previewing = true;
+    sliceStats.clear();
     currentIndex = 0;
+    reset();
     updateImage();
 }
 
+void ImageViewer::setSliceStats(std::vector<tomocam::preview::SliceStats> stats) {
+    stopPrefetch(); // slices are shown with a new range
+    if (!previewing && stats.size() == imageStack.nslices())
+        sliceStats = std::move(stats);
+    else
+        sliceStats.clear();
+}
+
 void ImageViewer::keyPressEvent(QKeyEvent *event) {
 
-    if (imageStack.size() <= 0) {
+    if (nslices() <= 0) {
         QGraphicsView::keyReleaseEvent(event);
         return;
     }
 
-    int nImgs = imageStack.nslices();
+    int nImgs = nslices();
     int oldIndex = currentIndex;
     switch (event->key()) {
     case Qt::Key_Up:
+        step = 1;
         currentIndex = (currentIndex + 1) % nImgs;
         break;
     case Qt::Key_Down:
+        step = -1;
         currentIndex = (currentIndex - 1 + nImgs) % nImgs;
         break;
     case Qt::Key_PageUp:
+        step = 5;
         currentIndex = (currentIndex + 5) % nImgs;
         break;
     case Qt::Key_PageDown:
-        currentIndex = (currentIndex - 5) % nImgs;
+        step = -5;
+        currentIndex = ((currentIndex - 5) % nImgs + nImgs) % nImgs;
         break;
     case Qt::Key_Home:
         currentIndex = 0;
@@ -164,25 +268,58 @@ void ImageViewer::keyPressEvent(QKeyEvent *event) {
     }
 }
 
-void ImageViewer::export_patches(std::filesystem::path subdir) {
-
-    float maxR = get_realRadius();
-    float cenX = get_realCenX();
-    float cenY = get_realCenY();
-
-    float constexpr SECTOR_SIZE = 2 * M_PI / PATCHES_PER_FRAME;
-    for (int i = 0; i < imageStack.nslices(); i++) {
-        for (int j = 0; j < PATCHES_PER_FRAME; j++) {
-            float t = (j + random<float>()) * SECTOR_SIZE;
-            float r = random<float>() * maxR;
-            float x = cenX + r * std::cos(t);
-            float y = cenY + r * std::sin(t);
-            char pname[20];
-            snprintf(pname, 20, "%05d.tif", counter);
-            auto tifname = std::filesystem::path(pname);
-            tomocam::dims_t loc{(uint32_t)i, (uint32_t)y, (uint32_t)x};
-            save_patch((subdir / tifname).string(), imageStack, loc);
-            counter += 1;
-        }
-    }
+tomocam::SampleStats ImageViewer::export_patches(std::filesystem::path subdir) {
+    TOMOCAM_TRACE_SCOPE("export_patches", "export");
+    auto t0 = tomocam::trace::clock::now();
+
+    tomocam::SampleStats stats;
+    auto locs = tomocam::sample_patches(imageStack, fov(), PATCHES_PER_FRAME, qualityFilter,
+                                        rng, stats);
+
+    // numbered after whatever is in subdir already, queued exports included
+    int first = tomocam::next_patch_index(subdir);
+    uint64_t written = tomocam::write_patches(imageStack, locs, subdir, first, tiffOptions);
+
+    auto &metrics = tomocam::trace::Metrics::instance();
+    metrics.export_patches = written;
+    metrics.export_us = tomocam::trace::elapsed_us(t0);
+    return stats;
+}
+
+tomocam::SampleStats ImageViewer::export_volumes(const tomocam::VolumeExport &opts) {
+    return tomocam::export_volumes(imageStack, fov(), opts, qualityFilter, rng);
+}
+
+// runs with the prefetches, so stopPrefetch() lets it finish before
+// imageStack changes and the result of a replaced stack is dropped
+void ImageViewer::detectFov(const tomocam::DetectOptions &opts) {
+    if (previewing || imageStack.size() == 0)
+        return;
+    uint64_t id = stackId;
+    prefetches.push_back(prefetchPool.submit([this, id, opts]() {
+        if (stackId != id)
+            return;
+        auto d = tomocam::detect_fov(imageStack, opts);
+        QMetaObject::invokeMethod(
+            this,
+            [this, id, d]() {
+                if (stackId != id)
+                    return;
+                if (d.ok)
+                    setFov(d.fov);
+                emit fovDetected(d);
+            },
+            Qt::QueuedConnection);
+    }));
+}
+
+void ImageViewer::setFov(const tomocam::Circle &c) {
+    realCenX = c.cx;
+    realCenY = c.cy;
+    realRmax = c.r;
+    center = QPoint(static_cast<int>(c.cx / scaleW), static_cast<int>(c.cy / scaleH));
+    radius = QPoint(static_cast<int>((c.cx + c.r) / scaleW), center.y());
+    pickedCenter = true;
+    pickedRadius = true;
+    emit picksCompleted(center, radius);
 }
@@ -3,10 +3,22 @@
 #include <QGraphicsView>
 #include <QImage>
 #include <QWheelEvent>
+#include <atomic>
 #include <filesystem>
+#include <future>
+#include <random>
+#include <vector>
 #include <qevent.h>
 
+#include "fov_detect.h"
 #include "io/array.h"
+#include "io/integral.h"
+#include "io/preview.h"
+#include "io/slice_cache.h"
+#include "io/thread_pool.h"
+#include "io/tiff/tiffio.h"
+#include "patch_sampler.h"
+#include "volume_export.h"
 
 #ifndef IMG_VIEWER__H
 #define IMG_VIEWER__H
@@ -18,21 +30,39 @@ class ImageViewer : public QGraphicsView {
 
   public:
     ImageViewer(const tomocam::Array<float> &, QWidget *parent = nullptr);
+    ~ImageViewer();
     void updateImage();
-    void updateImageStack(const tomocam::Array<float> &);
-    void export_patches(std::filesystem::path);
+    void updateImageStack(const tomocam::Array<float> &, bool keepIndex = false);
+    void updateImageStack(tomocam::Array<float> &&, bool keepIndex = false);
+    // show a downsampled 8-bit stack until full resolution data arrives
+    void showPreview(tomocam::Array<uint8_t> &&, tomocam::dims_t full);
+    bool isPreview() const { return previewing; }
+    // cached per-slice min/max used for display instead of a reduction
+    void setSliceStats(std::vector<tomocam::preview::SliceStats>);
+    tomocam::SampleStats export_patches(std::filesystem::path);
+    tomocam::SampleStats export_volumes(const tomocam::VolumeExport &);
+    int nslices() const { return previewing ? previewStack.nslices() : imageStack.nslices(); }
+    // counters of the display slice cache
+    tomocam::CacheStats cacheStats() const { return displayCache.stats(); }
 
     // Access picked pixels
     void setPickMode(PickMode mode) { pickMode = mode; }
+    void setTiffOptions(const tomocam::tiff::WriteOptions &opts) { tiffOptions = opts; }
+    const tomocam::tiff::WriteOptions &getTiffOptions() const { return tiffOptions; }
+    void setQualityFilter(const tomocam::QualityFilter &f) { qualityFilter = f; }
+    const tomocam::QualityFilter &getQualityFilter() const { return qualityFilter; }
     QPoint getCenter() const { return center; }
     QPoint getRadius() const { return radius; }
     bool picksReady() const { return pickedCenter && pickedRadius; }
-    float get_realCenX() const { return scaleW * center.x(); }
-    float get_realCenY() const { return scaleH * center.y(); }
-    float get_realRadius() const {
-        return std::sqrt(std::pow(scaleW * (radius.x() - center.x()), 2) +
-                         std::pow(scaleH * (radius.y() - center.y()), 2));
-    }
+    // picks in full resolution pixels of the current stack
+    float get_realCenX() const { return realCenX; }
+    float get_realCenY() const { return realCenY; }
+    float get_realRadius() const { return realRmax; }
+    tomocam::Circle fov() const { return {realCenX, realCenY, realRmax}; }
+    void setFov(const tomocam::Circle &);
+    // fit the field of view to the stack in the background; fovDetected
+    // follows on this thread and the picks are set on success
+    void detectFov(const tomocam::DetectOptions &opts = {});
     // reset center + radius
     void reset() {
         pickedCenter = false;
@@ -42,6 +72,7 @@ class ImageViewer : public QGraphicsView {
   signals:
     void picksCompleted(QPoint p1, QPoint p2);
     void pickUpdated(int, QPoint);
+    void fovDetected(const tomocam::Detection &);
 
   public slots:
     void toggle_save_option(bool sw) {
@@ -59,11 +90,13 @@ class ImageViewer : public QGraphicsView {
   private:
     QGraphicsScene *scene;
     tomocam::Array<float> imageStack;
+    tomocam::Array<uint8_t> previewStack;
+    tomocam::dims_t previewDims;
+    bool previewing;
+    std::vector<tomocam::preview::SliceStats> sliceStats;
     int currentIndex;
-    int counter;
+    int step;                       // last scroll step, prefetch runs ahead of it
     bool save_roi_flag;
-    float minVal;
-    float maxVal;
     QPoint center;
     QPoint radius;
     bool pickedCenter;
@@ -74,8 +107,19 @@ class ImageViewer : public QGraphicsView {
     float realCenX;
     float realCenY;
     float realRmax;
+    tomocam::tiff::WriteOptions tiffOptions;
+    tomocam::QualityFilter qualityFilter;
+    std::mt19937 rng;
+    // 8-bit display slices of imageStack, keyed by stackId
+    tomocam::SliceCache<uint8_t> displayCache;
+    std::atomic<uint64_t> stackId;
+    std::vector<std::future<void>> prefetches;
+    tomocam::ThreadPool prefetchPool{1};
 
-    QImage floatArrayToQImage(const tomocam::Slice<float> &);
+    tomocam::SliceCache<uint8_t>::Handle displaySlice(uint64_t id, int i);
+    void prefetch();
+    void stopPrefetch();
+    QImage fitToWindow(const QImage &, int h, int w);
 };
 
 #endif // IMG_VIEWER__H
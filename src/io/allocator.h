@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <type_traits>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#ifndef TOMOCAM_ALLOCATOR__H
+#define TOMOCAM_ALLOCATOR__H
+
+namespace tomocam {
+
+    /* Allocation policies for Array.
+     * A policy provides
+     *   template <typename T> static T *allocate(size_t n);
+     *   template <typename T> static void deallocate(T *p, size_t n);
+     * Storage handed out by allocate() is only guaranteed to be
+     * initialized when the policy says so.
+     */
+    namespace alloc {
+
+        constexpr size_t CACHE_LINE = 64;
+        constexpr size_t PAGE_SIZE = 4096;
+        constexpr size_t HUGE_PAGE = 2 << 20;
+
+        // buffers at least this large get huge page alignment and hints
+        constexpr size_t HUGE_THRESHOLD = 32 << 20;
+
+        inline size_t round_up(size_t n, size_t a) { return (n + a - 1) / a * a; }
+
+        inline void *aligned(size_t bytes, size_t align) {
+            if (bytes == 0) return nullptr;
+            void *p = std::aligned_alloc(align, round_up(bytes, align));
+            if (!p) throw std::bad_alloc();
+            return p;
+        }
+
+        // ask for transparent huge pages, a no-op where unsupported
+        inline void advise_huge(void *p, size_t bytes) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+            madvise(p, round_up(bytes, HUGE_PAGE), MADV_HUGEPAGE);
+#endif
+        }
+
+        /** touch one byte per page from the threads that will later work
+         * on the data. With a static schedule each thread faults in its own
+         * contiguous slab, so pages land on that thread's NUMA node (bind
+         * threads with OMP_PROC_BIND for this to hold).
+         */
+        inline void first_touch(void *p, size_t bytes) {
+            auto *b = static_cast<volatile char *>(p);
+            int64_t npages = static_cast<int64_t>((bytes + PAGE_SIZE - 1) / PAGE_SIZE);
+#pragma omp parallel for schedule(static)
+            for (int64_t i = 0; i < npages; i++) b[i * PAGE_SIZE] = 0;
+        }
+
+        /** cache-line aligned, uninitialized, parallel first touch
+         * Large buffers are huge page aligned and advised for THP.
+         * This is the default for Array: loaders overwrite every element.
+         */
+        struct FirstTouch {
+            template <typename T>
+            static T *allocate(size_t n) {
+                static_assert(std::is_trivially_copyable_v<T>,
+                    "uninitialized storage needs a trivially copyable type");
+                size_t bytes = n * sizeof(T);
+                bool huge = bytes >= HUGE_THRESHOLD;
+                void *p = aligned(bytes, huge ? HUGE_PAGE : CACHE_LINE);
+                if (huge) {
+                    advise_huge(p, bytes);
+                    first_touch(p, bytes);
+                }
+                return static_cast<T *>(p);
+            }
+
+            template <typename T>
+            static void deallocate(T *p, size_t) {
+                std::free(p);
+            }
+        };
+
+        // cache-line aligned, uninitialized, no touching at all
+        struct Uninitialized {
+            template <typename T>
+            static T *allocate(size_t n) {
+                static_assert(std::is_trivially_copyable_v<T>,
+                    "uninitialized storage needs a trivially copyable type");
+                return static_cast<T *>(aligned(n * sizeof(T), CACHE_LINE));
+            }
+
+            template <typename T>
+            static void deallocate(T *p, size_t) {
+                std::free(p);
+            }
+        };
+
+        // like FirstTouch, but zero-filled in parallel
+        struct Zeroed {
+            template <typename T>
+            static T *allocate(size_t n) {
+                T *p = FirstTouch::allocate<T>(n);
+                auto *b = reinterpret_cast<char *>(p);
+                size_t bytes = n * sizeof(T);
+                int64_t nchunks = static_cast<int64_t>((bytes + HUGE_PAGE - 1) / HUGE_PAGE);
+#pragma omp parallel for schedule(static)
+                for (int64_t i = 0; i < nchunks; i++) {
+                    size_t off = static_cast<size_t>(i) * HUGE_PAGE;
+                    std::memset(b + off, 0, std::min(HUGE_PAGE, bytes - off));
+                }
+                return p;
+            }
+
+            template <typename T>
+            static void deallocate(T *p, size_t n) {
+                FirstTouch::deallocate(p, n);
+            }
+        };
+    } // namespace alloc
+} // namespace tomocam
+#endif // TOMOCAM_ALLOCATOR__H
@@ -1,6 +1,10 @@
 #include <algorithm>
 #include <cstdint>
 #include <memory>
+#include <stdexcept>
+
+#include "allocator.h"
+#include "reductions.h"
 
 #ifndef ARRAY__H
 #define ARRAY__H
@@ -13,6 +17,25 @@ namespace tomocam {
         uint32_t n2;
     };
 
+    // sub-block of a volume, a zero count runs to the end of that axis
+    struct Roi {
+        dims_t start{0, 0, 0};
+        dims_t count{0, 0, 0};
+
+        // resolve zero counts against the full extent, check bounds
+        Roi clip(dims_t full) const {
+            Roi r = *this;
+            uint32_t *s = &r.start.n0;
+            uint32_t *c = &r.count.n0;
+            const uint32_t *f = &full.n0;
+            for (int d = 0; d < 3; d++) {
+                if (s[d] >= f[d]) throw std::runtime_error("ROI out of bounds");
+                if (c[d] == 0 || s[d] + c[d] > f[d]) c[d] = f[d] - s[d];
+            }
+            return r;
+        }
+    };
+
     template <typename T>
     struct Slice {
         uint32_t nrows;
@@ -20,32 +43,59 @@ namespace tomocam {
         T *ptr;
         T &operator[](uint32_t i) { return ptr[i]; }
         const T &operator[](uint32_t i) const { return ptr[i]; }
+        T *begin() const { return ptr; }
+        uint64_t size() const { return uint64_t(nrows) * ncols; }
     };
 
+    // read-only 2D window into a slice, rows are `stride` elements apart
     template <typename T>
+    struct View2D {
+        uint32_t nrows;
+        uint32_t ncols;
+        uint32_t stride;
+        const T *ptr;
+        const T *row(uint32_t j) const { return ptr + j * stride; }
+        bool contiguous() const { return stride == ncols; }
+    };
+
+    /** 3D volume, slices x rows x cols, row-major
+     * @tparam Alloc allocation policy (see allocator.h); the default leaves
+     * storage uninitialized, use alloc::Zeroed or fill() when zeros matter
+     */
+    template <typename T, typename Alloc = alloc::FirstTouch>
     class Array {
       private:
+        struct Deleter {
+            uint64_t n;
+            void operator()(T *p) const {
+                if (p) Alloc::template deallocate<T>(p, n);
+            }
+        };
+
         dims_t dims_;
-        uint32_t size_;
-        std::unique_ptr<T[]> ptr_;
+        uint64_t size_;
+        std::unique_ptr<T[], Deleter> ptr_;
+
+        static std::unique_ptr<T[], Deleter> allocate(uint64_t n) {
+            return std::unique_ptr<T[], Deleter>(
+                Alloc::template allocate<T>(n), Deleter{n});
+        }
 
       public:
-        Array() : dims_(0, 0, 0), size_(0), ptr_(nullptr) {}
+        Array() : dims_(0, 0, 0), size_(0), ptr_(nullptr, Deleter{0}) {}
 
         Array(uint32_t x, uint32_t y, uint32_t z) :
             dims_{x, y, z},
-            size_(x * y * z),
-            ptr_(std::make_unique<T[]>(size_)) {}
+            size_(uint64_t(x) * y * z),
+            ptr_(allocate(size_)) {}
 
         Array(dims_t d) :
             dims_(d),
-            size_(d.n1 * d.n2 * d.n0),
-            ptr_(std::make_unique<T[]>(size_)) {}
+            size_(uint64_t(d.n1) * d.n2 * d.n0),
+            ptr_(allocate(size_)) {}
 
-        Array(const Array &rhs) {
-            dims_ = rhs.dims_;
-            size_ = rhs.size_;
-            ptr_ = std::make_unique<T[]>(size_);
+        Array(const Array &rhs) :
+            dims_(rhs.dims_), size_(rhs.size_), ptr_(allocate(rhs.size_)) {
             std::copy(rhs.begin(), rhs.end(), ptr_.get());
         }
 
@@ -54,14 +104,34 @@ namespace tomocam {
                 dims_ = rhs.dims_;
                 size_ = rhs.size_;
                 ptr_.reset();
-                ptr_ = std::make_unique<T[]>(size_);
+                ptr_ = allocate(size_);
                 std::copy(rhs.begin(), rhs.end(), ptr_.get());
             }
             return *this;
         }
 
-        uint32_t flatIdx(uint32_t i, uint32_t j, uint32_t k) const {
-            return (i * dims_.n1 * dims_.n2 + j * dims_.n2 + k);
+        // the source is left empty, not with a size and no storage
+        Array(Array &&rhs) noexcept :
+            dims_(rhs.dims_), size_(rhs.size_), ptr_(std::move(rhs.ptr_)) {
+            rhs.dims_ = {0, 0, 0};
+            rhs.size_ = 0;
+        }
+
+        Array &operator=(Array &&rhs) noexcept {
+            if (this != &rhs) {
+                dims_ = rhs.dims_;
+                size_ = rhs.size_;
+                ptr_ = std::move(rhs.ptr_);
+                rhs.dims_ = {0, 0, 0};
+                rhs.size_ = 0;
+            }
+            return *this;
+        }
+
+        void fill(T value) { std::fill(begin(), end(), value); }
+
+        uint64_t flatIdx(uint32_t i, uint32_t j, uint32_t k) const {
+            return (uint64_t(i) * dims_.n1 * dims_.n2 + uint64_t(j) * dims_.n2 + k);
         }
 
         T *begin() { return ptr_.get(); }
@@ -70,14 +140,14 @@ namespace tomocam {
         const T *end() const { return ptr_.get() + size_; }
 
         [[nodiscard]] dims_t dims() const { return dims_; }
-        [[nodiscard]] uint32_t size() const { return size_; }
+        [[nodiscard]] uint64_t size() const { return size_; }
         [[nodiscard]] uint32_t nslices() const { return dims_.n0; }
         [[nodiscard]] uint32_t nrows() const { return dims_.n1; }
         [[nodiscard]] uint32_t ncols() const { return dims_.n2; }
 
         // indexing
-        T &operator[](uint32_t i) { return ptr_[i]; }
-        T operator[](uint32_t i) const { return ptr_[i]; }
+        T &operator[](uint64_t i) { return ptr_[i]; }
+        T operator[](uint64_t i) const { return ptr_[i]; }
 
 #if (__cplusplus == 202302L)
         T &operator[](uint32_t i, uint32_t j, uint32_t k) {
@@ -93,25 +163,24 @@ namespace tomocam {
             return ptr_[flatIdx(i.n0, i.n1, i.n2)];
         }
 
+        // 2D window of slice i, starting at (y0, x0), no copy
+        auto view(uint32_t i, uint32_t y0, uint32_t x0, uint32_t ny,
+            uint32_t nx) const {
+            return View2D<T>{ny, nx, dims_.n2, ptr_.get() + flatIdx(i, y0, x0)};
+        }
+
         // get slices
         auto slice(uint32_t i) {
-            return Slice<T>{dims_.n1, dims_.n2,
-                ptr_.get() + (i * dims_.n1 * dims_.n2)};
+            return Slice<T>{dims_.n1, dims_.n2, ptr_.get() + flatIdx(i, 0, 0)};
         }
         auto slice(uint32_t i) const {
-            return Slice<T>{dims_.n1, dims_.n2,
-                ptr_.get() + (i * dims_.n1 * dims_.n2)};
+            return Slice<T>{dims_.n1, dims_.n2, ptr_.get() + flatIdx(i, 0, 0)};
         }
 
-        T min() const {
-            auto min_it = std::min_element(this->begin(), this->end());
-            return *min_it;
-        }
-
-        T max() const {
-            auto max_it = std::max_element(this->begin(), this->end());
-            return *max_it;
-        }
+        // parallel, vectorized reductions, see reductions.h
+        reduce::MinMax<T> minmax() const { return reduce::minmax(begin(), size_); }
+        T min() const { return minmax().min; }
+        T max() const { return minmax().max; }
     };
 } // namespace tomocam
 #endif // ARRAY__H
@@ -0,0 +1,470 @@
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#if defined(__linux__) && !defined(TOMOCAM_NO_URING)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define TOMOCAM_HAVE_URING 1
+#endif
+
+#include "thread_pool.h"
+#include "trace.h"
+
+#ifndef TOMOCAM_ASYNC_WRITER__H
+#define TOMOCAM_ASYNC_WRITER__H
+
+namespace tomocam::aio {
+
+    // one complete file: created (or truncated), written, closed
+    struct WriteJob {
+        std::string path;
+        std::vector<uint8_t> data;
+    };
+
+    class Backend {
+      protected:
+        std::mutex err_mtx_;
+        std::string error_;
+
+        void set_error(const std::string &path, int err) {
+            std::lock_guard<std::mutex> lock(err_mtx_);
+            if (error_.empty())
+                error_ = path + ": " + std::strerror(err);
+        }
+
+        void throw_if_error() {
+            std::lock_guard<std::mutex> lock(err_mtx_);
+            if (!error_.empty()) {
+                std::string msg = std::move(error_);
+                error_.clear();
+                throw std::runtime_error("async write failed: " + msg);
+            }
+        }
+
+      public:
+        virtual ~Backend() = default;
+        virtual void submit(WriteJob job) = 0;
+        virtual void wait() = 0;
+        virtual const char *name() const = 0;
+    };
+
+    /** portable backend: blocking open/write/close on a thread pool
+     * At most `depth` files are in flight; submit() blocks beyond that.
+     */
+    class PoolBackend : public Backend {
+      private:
+        unsigned depth_;
+        unsigned inflight_;
+        std::mutex mtx_;
+        std::condition_variable cv_;
+        ThreadPool pool_;
+
+        void write_file(const WriteJob &job) {
+            int fd = ::open(job.path.c_str(),
+                O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0) {
+                set_error(job.path, errno);
+                return;
+            }
+            const uint8_t *p = job.data.data();
+            size_t left = job.data.size();
+            while (left > 0) {
+                ssize_t n = ::write(fd, p, left);
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    set_error(job.path, errno);
+                    break;
+                }
+                p += n;
+                left -= n;
+            }
+            if (::close(fd) < 0) set_error(job.path, errno);
+        }
+
+      public:
+        PoolBackend(unsigned depth, size_t nthreads = 0) :
+            depth_(depth), inflight_(0), pool_(nthreads) {}
+
+        ~PoolBackend() override {
+            std::unique_lock<std::mutex> lock(mtx_);
+            cv_.wait(lock, [this] { return inflight_ == 0; });
+        }
+
+        void submit(WriteJob job) override {
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                cv_.wait(lock, [this] { return inflight_ < depth_; });
+                inflight_++;
+            }
+            pool_.submit([this, job = std::move(job)] {
+                TOMOCAM_TRACE_SCOPE("aio::write_file", "io");
+                write_file(job);
+                {
+                    std::lock_guard<std::mutex> lock(mtx_);
+                    inflight_--;
+                }
+                cv_.notify_all();
+            });
+        }
+
+        void wait() override {
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                cv_.wait(lock, [this] { return inflight_ == 0; });
+            }
+            throw_if_error();
+        }
+
+        const char *name() const override { return "threads"; }
+    };
+
+#ifdef TOMOCAM_HAVE_URING
+    /** io_uring backend
+     * Every file is a linked OPENAT -> WRITE -> CLOSE chain on a direct
+     * (registered) descriptor slot, so one io_uring_enter() submits a whole
+     * batch of files without any per-file syscalls. The number of slots
+     * bounds the files in flight.
+     */
+    class UringBackend : public Backend {
+      private:
+        enum Op : uint64_t { OPEN = 0, WRITE = 1, CLOSE = 2 };
+
+        struct Slot {
+            WriteJob job;
+            int pending; // CQEs still expected for this file
+        };
+
+        int ring_fd_;
+        unsigned depth_;
+        unsigned batch_;
+        unsigned unsubmitted_;
+        unsigned busy_;
+
+        void *sq_ptr_;
+        size_t sq_size_;
+        void *cq_ptr_;
+        size_t cq_size_;
+        io_uring_sqe *sqes_;
+        size_t sqes_size_;
+
+        unsigned *sq_tail_;
+        unsigned *sq_mask_;
+        unsigned *sq_array_;
+        unsigned *cq_head_;
+        unsigned *cq_tail_;
+        unsigned *cq_mask_;
+        io_uring_cqe *cqes_;
+
+        std::vector<Slot> slots_;
+        std::vector<unsigned> free_;
+        std::mutex mtx_;
+
+        static int enter(int fd, unsigned to_submit, unsigned min_complete,
+            unsigned flags) {
+            return static_cast<int>(syscall(__NR_io_uring_enter, fd,
+                to_submit, min_complete, flags, nullptr, 0));
+        }
+
+        io_uring_sqe *next_sqe() {
+            unsigned tail = *sq_tail_;
+            unsigned idx = tail & *sq_mask_;
+            io_uring_sqe *sqe = &sqes_[idx];
+            std::memset(sqe, 0, sizeof(*sqe));
+            sq_array_[idx] = idx;
+            __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+            unsubmitted_++;
+            return sqe;
+        }
+
+        void flush() {
+            while (unsubmitted_ > 0) {
+                int ret = enter(ring_fd_, unsubmitted_, 0, 0);
+                if (ret < 0) {
+                    if (errno == EINTR) continue;
+                    if (errno == EAGAIN || errno == EBUSY) {
+                        reap(1);
+                        continue;
+                    }
+                    throw std::runtime_error(std::string("io_uring_enter: ") +
+                                             std::strerror(errno));
+                }
+                unsubmitted_ -= ret;
+            }
+        }
+
+        // harvest completions, blocking until at least min_complete arrive
+        void reap(unsigned min_complete) {
+            if (min_complete > 0) {
+                int ret = enter(ring_fd_, 0, min_complete,
+                    IORING_ENTER_GETEVENTS);
+                if (ret < 0 && errno != EINTR)
+                    throw std::runtime_error(
+                        std::string("io_uring_enter: ") + std::strerror(errno));
+            }
+            unsigned head = *cq_head_;
+            unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+            for (; head != tail; head++) {
+                const io_uring_cqe &cqe = cqes_[head & *cq_mask_];
+                unsigned slot = static_cast<unsigned>(cqe.user_data >> 2);
+                Op op = static_cast<Op>(cqe.user_data & 3);
+                Slot &s = slots_[slot];
+
+                // a failure cancels the rest of the chain: report the
+                // first real error only
+                if (cqe.res < 0 && cqe.res != -ECANCELED) {
+                    set_error(s.job.path, -cqe.res);
+                } else if (op == WRITE && cqe.res >= 0 &&
+                           static_cast<size_t>(cqe.res) != s.job.data.size()) {
+                    set_error(s.job.path, EIO);
+                }
+                if (--s.pending == 0) {
+                    s.job = WriteJob{};
+                    free_.push_back(slot);
+                    busy_--;
+                }
+            }
+            __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        }
+
+        // submit the one pending sqe and wait for its result
+        int run_one() {
+            flush();
+            while (true) {
+                unsigned head = *cq_head_;
+                if (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+                    int res = cqes_[head & *cq_mask_].res;
+                    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+                    return res;
+                }
+                if (enter(ring_fd_, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+                    return -errno;
+            }
+        }
+
+        /** can this kernel open into and close a registered slot?
+         * OPENAT/CLOSE exist since Linux 5.6, but file_index is only
+         * honoured from 5.15; older kernels ignore it, return a normal fd
+         * and the fixed-file write then fails with EBADF. Open /dev/null
+         * into slot 0 once and look at what comes back.
+         */
+        bool direct_files_work() {
+            constexpr unsigned nops = 256;
+            std::vector<uint8_t> buf(sizeof(io_uring_probe) + nops * sizeof(io_uring_probe_op));
+            auto *probe = reinterpret_cast<io_uring_probe *>(buf.data());
+            if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PROBE, probe, nops) < 0)
+                return false;
+            for (unsigned op : {IORING_OP_OPENAT, IORING_OP_WRITE, IORING_OP_CLOSE})
+                if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+                    return false;
+
+            io_uring_sqe *sqe = next_sqe();
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = reinterpret_cast<uint64_t>("/dev/null");
+            sqe->open_flags = O_WRONLY;
+            sqe->file_index = 1;
+            int res = run_one();
+            if (res > 0) ::close(res); // file_index ignored
+            if (res != 0) return false;
+
+            // only now: a CLOSE that ignored file_index would close fd 0
+            sqe = next_sqe();
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->file_index = 1;
+            return run_one() == 0;
+        }
+
+        void cleanup() {
+            if (sqes_) munmap(sqes_, sqes_size_);
+            if (cq_ptr_ && cq_ptr_ != sq_ptr_) munmap(cq_ptr_, cq_size_);
+            if (sq_ptr_) munmap(sq_ptr_, sq_size_);
+            if (ring_fd_ >= 0) ::close(ring_fd_);
+        }
+
+      public:
+        UringBackend(unsigned depth, unsigned batch) :
+            ring_fd_(-1), depth_(depth), batch_(std::max(1u, batch)),
+            unsubmitted_(0), busy_(0), sq_ptr_(nullptr), cq_ptr_(nullptr),
+            sqes_(nullptr), slots_(depth) {
+
+            io_uring_params p;
+            std::memset(&p, 0, sizeof(p));
+            ring_fd_ = static_cast<int>(
+                syscall(__NR_io_uring_setup, 3 * depth_, &p));
+            if (ring_fd_ < 0)
+                throw std::runtime_error("io_uring_setup failed");
+
+            sq_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+            cq_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+            bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+            if (single) sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+
+            sq_ptr_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+            if (sq_ptr_ == MAP_FAILED) {
+                sq_ptr_ = nullptr;
+                cleanup();
+                throw std::runtime_error("io_uring mmap failed");
+            }
+            cq_ptr_ = single ? sq_ptr_
+                             : mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_POPULATE, ring_fd_,
+                                   IORING_OFF_CQ_RING);
+            sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+            void *sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+            if (cq_ptr_ == MAP_FAILED || sqes == MAP_FAILED) {
+                if (cq_ptr_ == MAP_FAILED) cq_ptr_ = nullptr;
+                if (sqes != MAP_FAILED) sqes_ = (io_uring_sqe *)sqes;
+                cleanup();
+                throw std::runtime_error("io_uring mmap failed");
+            }
+            sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+            auto *sq = static_cast<char *>(sq_ptr_);
+            auto *cq = static_cast<char *>(cq_ptr_);
+            sq_tail_ = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+            sq_mask_ = reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+            sq_array_ = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+            cq_head_ = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+            cq_tail_ = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+            cq_mask_ = reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+            cqes_ = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+
+            // sparse table of direct descriptors, one per slot
+            std::vector<int> fds(depth_, -1);
+            if (syscall(__NR_io_uring_register, ring_fd_,
+                    IORING_REGISTER_FILES, fds.data(), depth_) < 0) {
+                cleanup();
+                throw std::runtime_error("io_uring file registration failed");
+            }
+            if (!direct_files_work()) {
+                cleanup();
+                throw std::runtime_error("io_uring lacks direct open/close (Linux 5.15+)");
+            }
+
+            free_.reserve(depth_);
+            for (unsigned i = depth_; i > 0; i--) free_.push_back(i - 1);
+        }
+
+        ~UringBackend() override {
+            try {
+                std::lock_guard<std::mutex> lock(mtx_);
+                flush();
+                while (busy_ > 0) reap(1);
+            } catch (...) {
+            }
+            cleanup();
+        }
+
+        void submit(WriteJob job) override {
+            if (job.data.size() > UINT32_MAX)
+                throw std::runtime_error("async write larger than 4 GB");
+
+            std::lock_guard<std::mutex> lock(mtx_);
+            while (free_.empty()) {
+                flush();
+                reap(1);
+            }
+            unsigned slot = free_.back();
+            free_.pop_back();
+            busy_++;
+            Slot &s = slots_[slot];
+            s.job = std::move(job);
+            s.pending = 3;
+            uint64_t tag = static_cast<uint64_t>(slot) << 2;
+
+            io_uring_sqe *sqe = next_sqe();
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->flags = IOSQE_IO_LINK;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = reinterpret_cast<uint64_t>(s.job.path.c_str());
+            sqe->len = 0644;
+            sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC;
+            sqe->file_index = slot + 1;
+            sqe->user_data = tag | OPEN;
+
+            sqe = next_sqe();
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->flags = IOSQE_IO_LINK | IOSQE_FIXED_FILE;
+            sqe->fd = static_cast<int>(slot);
+            sqe->addr = reinterpret_cast<uint64_t>(s.job.data.data());
+            sqe->len = static_cast<uint32_t>(s.job.data.size());
+            sqe->off = 0;
+            sqe->user_data = tag | WRITE;
+
+            sqe = next_sqe();
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->file_index = slot + 1;
+            sqe->user_data = tag | CLOSE;
+
+            if (unsubmitted_ >= 3 * batch_) flush();
+            reap(0);
+        }
+
+        void wait() override {
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                flush();
+                while (busy_ > 0) reap(1);
+            }
+            throw_if_error();
+        }
+
+        const char *name() const override { return "io_uring"; }
+    };
+#endif // TOMOCAM_HAVE_URING
+
+    /** batched asynchronous file output
+     * Uses io_uring when the kernel allows it and falls back to a thread
+     * pool otherwise. Jobs own their bytes; errors surface from wait().
+     */
+    class AsyncWriter {
+      private:
+        std::unique_ptr<Backend> impl_;
+
+      public:
+        /**
+         * @param depth maximum number of files in flight
+         * @param batch files per io_uring submission
+         */
+        AsyncWriter(unsigned depth = 64, unsigned batch = 16) {
+#ifdef TOMOCAM_HAVE_URING
+            try {
+                impl_ = std::make_unique<UringBackend>(depth, batch);
+            } catch (const std::exception &) {
+                impl_.reset();
+            }
+#endif
+            if (!impl_) impl_ = std::make_unique<PoolBackend>(depth);
+        }
+
+        ~AsyncWriter() {
+            try {
+                impl_->wait();
+            } catch (...) {
+            }
+        }
+
+        void submit(std::string path, std::vector<uint8_t> data) {
+            impl_->submit(WriteJob{std::move(path), std::move(data)});
+        }
+
+        // block until every submitted file is closed, throw on failure
+        void wait() { impl_->wait(); }
+
+        const char *backend() const { return impl_->name(); }
+    };
+} // namespace tomocam::aio
+#endif // TOMOCAM_ASYNC_WRITER__H
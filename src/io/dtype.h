@@ -0,0 +1,104 @@
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#ifndef TOMOCAM_DTYPE__H
+#define TOMOCAM_DTYPE__H
+
+namespace tomocam {
+
+    /* Sample types of the I/O layer, one table for every format.
+     *
+     * dtype_traits<T> maps a C++ type to its DType tag, its kind and size
+     * (which the HDF5 and TIFF layers turn into their own type codes) and
+     * its numpy/zarr type string. Using an unsupported T is a compile
+     * error. A file's type is looked up once when it is opened, and
+     * visit() turns it into a call of a fully typed function.
+     */
+
+    enum class DType : uint8_t { UInt8, UInt16, UInt32, UInt64, Int8, Int16, Int32, Int64, Float32, Float64 };
+
+    enum class Kind : uint8_t { Unsigned, Signed, Float };
+
+    template <typename T>
+    struct dtype_traits; // no entry: not a sample type
+
+#define TOMOCAM_DTYPE(T, ID, KIND, NAME, NUMPY)                                                    \
+    template <>                                                                                    \
+    struct dtype_traits<T> {                                                                       \
+        static constexpr DType id = DType::ID;                                                     \
+        static constexpr Kind kind = Kind::KIND;                                                   \
+        static constexpr uint32_t bits = 8 * sizeof(T);                                            \
+        static constexpr const char *name = NAME;                                                  \
+        static constexpr const char *numpy = NUMPY;                                                \
+    };
+
+    TOMOCAM_DTYPE(uint8_t, UInt8, Unsigned, "uint8", "|u1")
+    TOMOCAM_DTYPE(uint16_t, UInt16, Unsigned, "uint16", "<u2")
+    TOMOCAM_DTYPE(uint32_t, UInt32, Unsigned, "uint32", "<u4")
+    TOMOCAM_DTYPE(uint64_t, UInt64, Unsigned, "uint64", "<u8")
+    TOMOCAM_DTYPE(int8_t, Int8, Signed, "int8", "|i1")
+    TOMOCAM_DTYPE(int16_t, Int16, Signed, "int16", "<i2")
+    TOMOCAM_DTYPE(int32_t, Int32, Signed, "int32", "<i4")
+    TOMOCAM_DTYPE(int64_t, Int64, Signed, "int64", "<i8")
+    TOMOCAM_DTYPE(float, Float32, Float, "float32", "<f4")
+    TOMOCAM_DTYPE(double, Float64, Float, "float64", "<f8")
+#undef TOMOCAM_DTYPE
+
+    template <typename T>
+    concept Sample = requires { dtype_traits<T>::id; };
+
+    template <Sample T>
+    constexpr DType dtype_v = dtype_traits<T>::id;
+
+    /** tag of a sample type given by kind and width, as files describe it
+     * @throw std::runtime_error for a combination no table entry has
+     */
+    inline DType dtype_of(Kind kind, uint32_t bits) {
+        switch (kind) {
+        case Kind::Unsigned:
+            if (bits == 8) return DType::UInt8;
+            if (bits == 16) return DType::UInt16;
+            if (bits == 32) return DType::UInt32;
+            if (bits == 64) return DType::UInt64;
+            break;
+        case Kind::Signed:
+            if (bits == 8) return DType::Int8;
+            if (bits == 16) return DType::Int16;
+            if (bits == 32) return DType::Int32;
+            if (bits == 64) return DType::Int64;
+            break;
+        case Kind::Float:
+            if (bits == 32) return DType::Float32;
+            if (bits == 64) return DType::Float64;
+            break;
+        }
+        throw std::runtime_error("unsupported data type: " + std::to_string(bits) + "-bit " +
+                                 (kind == Kind::Float ? "float" : kind == Kind::Signed ? "int" : "uint"));
+    }
+
+    /** call f(std::type_identity<T>{}) with the type T of a tag; every
+     * branch is instantiated, so f must compile for all sample types
+     */
+    template <typename F>
+    decltype(auto) visit(DType t, F &&f) {
+        switch (t) {
+        case DType::UInt8: return f(std::type_identity<uint8_t>{});
+        case DType::UInt16: return f(std::type_identity<uint16_t>{});
+        case DType::UInt32: return f(std::type_identity<uint32_t>{});
+        case DType::UInt64: return f(std::type_identity<uint64_t>{});
+        case DType::Int8: return f(std::type_identity<int8_t>{});
+        case DType::Int16: return f(std::type_identity<int16_t>{});
+        case DType::Int32: return f(std::type_identity<int32_t>{});
+        case DType::Int64: return f(std::type_identity<int64_t>{});
+        case DType::Float32: return f(std::type_identity<float>{});
+        default: return f(std::type_identity<double>{});
+        }
+    }
+
+    inline const char *dtype_name(DType t) {
+        return visit(t, [](auto tag) { return dtype_traits<typename decltype(tag)::type>::name; });
+    }
+} // namespace tomocam
+#endif // TOMOCAM_DTYPE__H
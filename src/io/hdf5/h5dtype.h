@@ -18,25 +18,66 @@
  *---------------------------------------------------------------------------------
  */
 
+#include <complex>
+#include <cstdint>
 #include <hdf5.h>
+#include <mutex>
 #include <stdexcept>
 #include <type_traits>
 
+#include "../dtype.h"
+
 #ifndef H5DYPES_H
 #define H5DYPES_H
 
 namespace tomocam {
     namespace h5 {
-        template <typename T>
-        constexpr hid_t getH5Dtype() {
-            if (std::is_same<T, float>::value) {
-                return H5T_NATIVE_FLOAT;
-            } else if (std::is_same<T, double>::value) {
-                return H5T_NATIVE_DOUBLE;
-            } else if (std::is_same<T, int>::value) {
-                return H5T_NATIVE_INT;
-            } else {
-                throw std::runtime_error("Unsupported data type");
+        /* HDF5 keeps library-wide state; a default (non thread safe) build
+         * must never be entered from two threads at once, and a thread safe
+         * build serialises calls anyway. Reader, Writer and Appender take
+         * this lock in every member that calls the library, so files can be
+         * opened from the GUI, the load pool and the export queue alike.
+         * It is recursive because members call each other.
+         */
+        inline std::recursive_mutex &library_mutex() {
+            static std::recursive_mutex m;
+            return m;
+        }
+
+        // held for the scope of one library call sequence
+        inline std::lock_guard<std::recursive_mutex> lock() {
+            return std::lock_guard<std::recursive_mutex>(library_mutex());
+        }
+
+        // native HDF5 type of a sample type, see dtype.h
+        template <Sample T>
+        hid_t getH5Dtype() {
+            constexpr DType t = dtype_v<T>;
+            if constexpr (t == DType::UInt8) return H5T_NATIVE_UINT8;
+            else if constexpr (t == DType::UInt16) return H5T_NATIVE_UINT16;
+            else if constexpr (t == DType::UInt32) return H5T_NATIVE_UINT32;
+            else if constexpr (t == DType::UInt64) return H5T_NATIVE_UINT64;
+            else if constexpr (t == DType::Int8) return H5T_NATIVE_INT8;
+            else if constexpr (t == DType::Int16) return H5T_NATIVE_INT16;
+            else if constexpr (t == DType::Int32) return H5T_NATIVE_INT32;
+            else if constexpr (t == DType::Int64) return H5T_NATIVE_INT64;
+            else if constexpr (t == DType::Float32) return H5T_NATIVE_FLOAT;
+            else return H5T_NATIVE_DOUBLE;
+        }
+
+        /** sample type of a stored HDF5 type
+         * @throw std::runtime_error for types other than plain integers and floats
+         */
+        inline DType dtype_of(hid_t type) {
+            uint32_t bits = static_cast<uint32_t>(8 * H5Tget_size(type));
+            switch (H5Tget_class(type)) {
+            case H5T_FLOAT:
+                return tomocam::dtype_of(Kind::Float, bits);
+            case H5T_INTEGER:
+                return tomocam::dtype_of(
+                    H5Tget_sign(type) == H5T_SGN_NONE ? Kind::Unsigned : Kind::Signed, bits);
+            default:
+                throw std::runtime_error("unsupported HDF5 data type");
             }
         }
 
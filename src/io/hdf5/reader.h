@@ -18,12 +18,19 @@
  *---------------------------------------------------------------------------------
  */
 
+#include <algorithm>
 #include <cstdint>
 #include <fstream>
+#include <functional>
 #include <hdf5.h>
 #include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 #include "../array.h"
+#include "../trace.h"
 #include "h5dtype.h"
 
 #ifndef TOMOCAM_READER__H
@@ -31,19 +38,211 @@
 
 namespace tomocam::h5 {
 
+    // what a dataset holds, from metadata only
+    struct DatasetInfo {
+        std::string name;                 // path from the root, no leading '/'
+        std::vector<hsize_t> dims;
+        std::vector<hsize_t> chunks;      // empty when stored contiguously
+        std::string dtype;                // e.g. "float32", "uint16"
+        size_t element_size = 0;
+        std::vector<std::string> filters; // e.g. "shuffle", "deflate"
+        uint64_t stored_bytes = 0;        // allocated in the file
+        bool numeric = false;             // a sample type of dtype.h
+
+        // a volume the loader can read
+        bool volume() const { return numeric && dims.size() == 3; }
+
+        uint64_t bytes() const {
+            uint64_t n = element_size;
+            for (auto d : dims) n *= d;
+            return n;
+        }
+    };
+
+    namespace detail {
+        inline std::string type_name(hid_t type) {
+            size_t size = H5Tget_size(type);
+            switch (H5Tget_class(type)) {
+            case H5T_FLOAT:
+                return "float" + std::to_string(8 * size);
+            case H5T_INTEGER:
+                return (H5Tget_sign(type) == H5T_SGN_NONE ? "uint" : "int") +
+                       std::to_string(8 * size);
+            case H5T_COMPOUND:
+                return "compound";
+            case H5T_STRING:
+                return "string";
+            default:
+                return "other";
+            }
+        }
+
+        inline std::string key(const char *name) {
+            return (name[0] == '/') ? std::string(name + 1) : std::string(name);
+        }
+    } // namespace detail
+
+    // bytes per read when a read reports progress, see Reader::read_roi
+    constexpr uint64_t READ_SLAB_BYTES = uint64_t(64) << 20;
+
+    /** read-only HDF5 file
+     * Datasets are opened once and their handles are kept until the
+     * reader is destroyed. Calls into the library hold h5::lock(); one
+     * reader is still not meant to be shared between threads.
+     */
     class Reader {
       private:
         hid_t fp_;
+        std::map<std::string, hid_t> dsets_;
+
+        // metadata of an open dataset
+        static DatasetInfo describe(const std::string &name, hid_t dset) {
+            DatasetInfo info;
+            info.name = name;
+            hid_t space = H5Dget_space(dset);
+            int ndim = H5Sget_simple_extent_ndims(space);
+            if (ndim > 0) {
+                info.dims.resize(ndim);
+                H5Sget_simple_extent_dims(space, info.dims.data(), NULL);
+            }
+            H5Sclose(space);
+
+            hid_t type = H5Dget_type(dset);
+            info.dtype = detail::type_name(type);
+            info.element_size = H5Tget_size(type);
+            try {
+                dtype_of(type);
+                info.numeric = true;
+            } catch (const std::runtime_error &) {
+                // listed, but not readable
+            }
+            H5Tclose(type);
+
+            hid_t dcpl = H5Dget_create_plist(dset);
+            if (H5Pget_layout(dcpl) == H5D_CHUNKED && ndim > 0) {
+                info.chunks.resize(ndim);
+                H5Pget_chunk(dcpl, ndim, info.chunks.data());
+            }
+            int nfilters = H5Pget_nfilters(dcpl);
+            for (int i = 0; i < nfilters; i++) {
+                unsigned flags, config;
+                size_t nvalues = 0;
+                char fname[64] = {};
+                H5Z_filter_t id = H5Pget_filter2(dcpl, i, &flags, &nvalues, NULL,
+                    sizeof(fname), fname, &config);
+                info.filters.push_back(fname[0] ? fname : "filter " + std::to_string(id));
+            }
+            H5Pclose(dcpl);
+            info.stored_bytes = H5Dget_storage_size(dset);
+            return info;
+        }
 
       public:
-        Reader(const char *filename) { fp_ = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT); }
+        Reader(const char *filename) {
+            auto lk = lock();
+            fp_ = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+        }
+
+#ifdef H5_HAVE_PARALLEL
+        /** open through MPI-IO on every rank of comm (collective)
+         * Reads stay independent, each rank reads its own block.
+         */
+        Reader(const char *filename, MPI_Comm comm) {
+            auto lk = lock();
+            hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
+            H5Pset_fapl_mpio(fapl, comm, MPI_INFO_NULL);
+            fp_ = H5Fopen(filename, H5F_ACC_RDONLY, fapl);
+            H5Pclose(fapl);
+        }
+#endif
+
+        ~Reader() {
+            auto lk = lock();
+            for (auto &kv : dsets_) H5Dclose(kv.second);
+            if (fp_ >= 0) H5Fclose(fp_);
+        }
+
+        Reader(const Reader &) = delete;
+        Reader &operator=(const Reader &) = delete;
+
+        // cached handle of a dataset, opened on first use
+        hid_t open(const char *name) {
+            auto lk = lock();
+            auto k = detail::key(name);
+            auto it = dsets_.find(k);
+            if (it != dsets_.end()) return it->second;
+            hid_t dset = H5Dopen2(fp_, name, H5P_DEFAULT);
+            if (dset < 0) throw std::runtime_error("no dataset " + k);
+            dsets_.emplace(k, dset);
+            return dset;
+        }
+
+        /** every dataset in the file, in name order
+         * Only metadata is read: shape, type, chunking, filters and the
+         * stored size. The datasets stay open for later reads.
+         */
+        std::vector<DatasetInfo> list() {
+            TOMOCAM_TRACE_SCOPE("h5::list", "io");
+            auto lk = lock();
+            std::vector<std::string> names;
+            auto visit = [](hid_t, const char *name, const H5L_info_t *info, void *data) -> herr_t {
+                if (info->type == H5L_TYPE_HARD)
+                    static_cast<std::vector<std::string> *>(data)->push_back(name);
+                return 0;
+            };
+            H5Lvisit(fp_, H5_INDEX_NAME, H5_ITER_INC, visit, &names);
+
+            std::vector<DatasetInfo> sets;
+            for (auto &name : names) {
+                if (!dsets_.count(name)) {
+                    hid_t obj = H5Oopen(fp_, name.c_str(), H5P_DEFAULT);
+                    if (obj < 0) continue;
+                    if (H5Iget_type(obj) != H5I_DATASET) {
+                        H5Oclose(obj);
+                        continue;
+                    }
+                    dsets_.emplace(name, obj);
+                }
+                sets.push_back(describe(name, dsets_[name]));
+            }
+            return sets;
+        }
+
+        // metadata of one dataset
+        DatasetInfo info(const char *name) {
+            auto lk = lock();
+            return describe(detail::key(name), open(name));
+        }
 
-        ~Reader() { H5Fclose(fp_); }
+        bool valid() const { return fp_ >= 0; }
+
+        // true if the file has a dataset (or group) of this name
+        bool exists(const char *name) const {
+            auto lk = lock();
+            return H5Lexists(fp_, name, H5P_DEFAULT) > 0;
+        }
+
+        /** sample type of a dataset, for visit(); checked once when a
+         * file is opened, reads then run for that one type
+         * @throw std::runtime_error for types other than plain numbers
+         */
+        DType dtype(const char *name) {
+            auto lk = lock();
+            hid_t type = H5Dget_type(open(name));
+            try {
+                DType t = dtype_of(type);
+                H5Tclose(type);
+                return t;
+            } catch (...) {
+                H5Tclose(type);
+                throw;
+            }
+        }
 
         // get data dimenstions
         int dims(const char *dsetname, int dim) {
-
-            hid_t dset = H5Dopen2(fp_, dsetname, H5P_DEFAULT);
+            auto lk = lock();
+            hid_t dset = open(dsetname);
             hid_t dspc = H5Dget_space(dset);
             hsize_t dims[3] = {0, 0, 0}; // max 3D
             int ndim = H5Sget_simple_extent_dims(dspc, dims, NULL);
@@ -54,7 +253,6 @@ namespace tomocam::h5 {
                 throw std::runtime_error("Invalid dimension");
             }
             H5Sclose(dspc);
-            H5Dclose(dset);
             return static_cast<int>(dims[dim]);
         }
 
@@ -66,9 +264,11 @@ namespace tomocam::h5 {
          */
         template <typename T>
         Array<T> read_sinogram(const char *dataset, hsize_t begin = 0, hsize_t end = -1) {
+            TOMOCAM_TRACE_SCOPE("h5::read_sinogram", "io");
+            auto lk = lock();
 
             // open dataset
-            hid_t dset = H5Dopen2(fp_, dataset, H5P_DEFAULT);
+            hid_t dset = open(dataset);
 
             // get dataspace
             hid_t fspace = H5Dget_space(dset);
@@ -87,11 +287,8 @@ namespace tomocam::h5 {
             }
             hsize_t nslice = end - begin;
 
-            // data type
-            hid_t dtype = H5Dget_type(dset);
-            if (!(H5Tequal(dtype, getH5Dtype<T>()))) {
-                throw std::runtime_error("Data type mismatch");
-            }
+            // stored values are converted to T by the library if they differ
+            hid_t dtype = getH5Dtype<T>();
 
             // create memory space for reading
             hsize_t out_dims[3] = {dims[0], nslice, dims[2]};
@@ -102,7 +299,10 @@ namespace tomocam::h5 {
             hsize_t count[3] = {dims[0], nslice, dims[2]};
             hsize_t start[3] = {0, begin, 0};
             H5Sselect_hyperslab(fspace, H5S_SELECT_SET, start, NULL, count, NULL);
-            H5Dread(dset, dtype, out_space, fspace, H5P_DEFAULT, A.begin());
+            {
+                TOMOCAM_TRACE_SCOPE("H5Dread", "io");
+                H5Dread(dset, dtype, out_space, fspace, H5P_DEFAULT, A.begin());
+            }
 
             // allocate return value
             Array<T> B((uint32_t)nslice, (uint32_t)dims[0], (uint32_t)dims[2]);
@@ -112,19 +312,20 @@ namespace tomocam::h5 {
             for (uint32_t i = 0; i < nslice; i++)
                 for (uint32_t j = 0; j < dims[0]; j++)
                     for (uint32_t k = 0; k < dims[2]; k++)
-                        B(i, j, k) = A(j, i, k);
+                        B[{i, j, k}] = A[{j, i, k}];
 
             // clean up
             H5Sclose(out_space);
             H5Sclose(fspace);
-            H5Dclose(dset);
             return B;
         }
 
         template <typename T> Array<T> read2(const char *dataset, int begin = 0, int end = -1) {
+            TOMOCAM_TRACE_SCOPE("h5::read2", "io");
+            auto lk = lock();
 
             // open dataset
-            hid_t dset = H5Dopen2(fp_, dataset, H5P_DEFAULT);
+            hid_t dset = open(dataset);
 
             // get dataspace
             hid_t fspace = H5Dget_space(dset);
@@ -142,11 +343,7 @@ namespace tomocam::h5 {
             }
             hsize_t nslice = end - begin;
 
-            // data type
-            hid_t dtype = H5Dget_type(dset);
-            if (!(H5Tequal(dtype, getH5Dtype<T>()))) {
-                throw std::runtime_error("Data type mismatch");
-            }
+            hid_t dtype = getH5Dtype<T>();
 
             // create memory space for reading
             hsize_t out_dims[3] = {nslice, dims[1], dims[2]};
@@ -162,13 +359,71 @@ namespace tomocam::h5 {
             // clean up
             H5Sclose(out_space);
             H5Sclose(fspace);
-            H5Dclose(dset);
+            return A;
+        }
+
+        /** read a block of a 3D dataset
+         * Without progress the block is one hyperslab selection. With it,
+         * the block is read in slabs of about READ_SLAB_BYTES and the
+         * library lock is released between slabs, so a long read can be
+         * stopped and does not hold up other files.
+         * @param dataset dataset name
+         * @param roi {slice, row, col} start and count, zero count for all
+         * @param progress called after every slab with the fraction read,
+         * false stops the read and leaves the remaining slices unset
+         * @return data of shape roi.count
+         */
+        template <typename T>
+        Array<T> read_roi(const char *dataset, const Roi &roi,
+            const std::function<bool(double)> &progress = {}) {
+            TOMOCAM_TRACE_SCOPE("h5::read_roi", "io");
+
+            hid_t dset;
+            Roi r;
+            {
+                auto lk = lock();
+                dset = open(dataset);
+                hid_t fspace = H5Dget_space(dset);
+                hsize_t dims[3] = {0, 0, 0};
+                int ndim = H5Sget_simple_extent_dims(fspace, dims, NULL);
+                H5Sclose(fspace);
+                if (ndim != 3) {
+                    throw std::runtime_error("Data is not 3D");
+                }
+                r = roi.clip(dims_t{(uint32_t)dims[0], (uint32_t)dims[1], (uint32_t)dims[2]});
+            }
+
+            Array<T> A(r.count);
+            uint64_t slice = uint64_t(r.count.n1) * r.count.n2 * sizeof(T);
+            uint32_t step = r.count.n0;
+            if (progress && slice > 0)
+                step = static_cast<uint32_t>(std::clamp<uint64_t>(READ_SLAB_BYTES / slice, 1, step));
+            for (uint32_t z = 0; z < r.count.n0; z += step) {
+                uint32_t n = std::min(step, r.count.n0 - z);
+                hsize_t start[3] = {r.start.n0 + z, r.start.n1, r.start.n2};
+                hsize_t count[3] = {n, r.count.n1, r.count.n2};
+                herr_t err;
+                {
+                    auto lk = lock();
+                    hid_t fspace = H5Dget_space(dset);
+                    hid_t out_space = H5Screate_simple(3, count, NULL);
+                    H5Sselect_hyperslab(fspace, H5S_SELECT_SET, start, NULL, count, NULL);
+                    err = H5Dread(dset, getH5Dtype<T>(), out_space, fspace, H5P_DEFAULT,
+                        A.begin() + A.flatIdx(z, 0, 0));
+                    H5Sclose(out_space);
+                    H5Sclose(fspace);
+                }
+                if (err < 0) throw std::runtime_error("failed to read " + detail::key(dataset));
+                if (progress && !progress(double(z + n) / r.count.n0)) break;
+            }
             return A;
         }
 
         template <typename T> std::vector<T> read(const char *dataset) {
+            TOMOCAM_TRACE_SCOPE("h5::read", "io");
+            auto lk = lock();
             // open dataset
-            hid_t dset = H5Dopen2(fp_, dataset, H5P_DEFAULT);
+            hid_t dset = open(dataset);
 
             // get dataspace
             hid_t fspace = H5Dget_space(dset);
@@ -177,11 +432,7 @@ namespace tomocam::h5 {
             hsize_t dims[1] = {0};
             int ndim = H5Sget_simple_extent_dims(fspace, dims, NULL);
 
-            // data type
             hid_t dtype = getH5Dtype<T>();
-            if (!(H5Tequal(dtype, getH5Dtype<T>()))) {
-                throw std::runtime_error("Data type mismatch");
-            }
 
             // allocate return value
             std::vector<T> a(dims[0]);
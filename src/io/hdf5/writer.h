@@ -19,6 +19,8 @@
  */
 
 #include <hdf5.h>
+#include <stdexcept>
+#include <vector>
 
 #include "../array.h"
 #include "h5dtype.h"
@@ -35,20 +37,152 @@ namespace tomocam {
     };
 
     namespace h5 {
+        /** extendable dataset of equally shaped items, e.g. patches
+         * Shape is (N, item...) with one chunk per item, so a reader that
+         * pulls one patch touches exactly one chunk.
+         */
+        template <typename T>
+        class Appender {
+          private:
+            hid_t dset_;
+            hid_t dxpl_;
+            std::vector<hsize_t> item_;
+            hsize_t count_;
+
+          public:
+            /**
+             * @param loc file or group
+             * @param name dataset name
+             * @param item shape of one item
+             * @param deflate gzip level, 0 for none
+             * @param dxpl transfer properties, collective for a shared file
+             */
+            Appender(hid_t loc, const char *name, std::vector<hsize_t> item,
+                int deflate = 0, hid_t dxpl = H5P_DEFAULT) :
+                dxpl_(dxpl), item_(std::move(item)), count_(0) {
+                auto lk = lock();
+                int rank = static_cast<int>(item_.size()) + 1;
+                std::vector<hsize_t> dims(rank, 0), maxdims(rank),
+                    chunk(rank);
+                maxdims[0] = H5S_UNLIMITED;
+                chunk[0] = 1;
+                for (int d = 1; d < rank; d++)
+                    dims[d] = maxdims[d] = chunk[d] = item_[d - 1];
+
+                hid_t space = H5Screate_simple(rank, dims.data(), maxdims.data());
+                hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+                H5Pset_chunk(dcpl, rank, chunk.data());
+                if (deflate > 0) H5Pset_deflate(dcpl, deflate);
+                dset_ = H5Dcreate(loc, name, getH5Dtype<T>(), space,
+                    H5P_DEFAULT, dcpl, H5P_DEFAULT);
+                H5Pclose(dcpl);
+                H5Sclose(space);
+                if (dset_ < 0)
+                    throw std::runtime_error("failed to create dataset");
+            }
+
+            ~Appender() {
+                auto lk = lock();
+                if (dset_ >= 0) H5Dclose(dset_);
+            }
+
+            Appender(const Appender &) = delete;
+            Appender &operator=(const Appender &) = delete;
+            Appender(Appender &&rhs) noexcept :
+                dset_(rhs.dset_), dxpl_(rhs.dxpl_), item_(std::move(rhs.item_)),
+                count_(rhs.count_) {
+                rhs.dset_ = -1;
+            }
+
+            hsize_t size() const { return count_; }
+
+            // append n items stored back to back at data
+            void append(const T *data, hsize_t n) { append(data, n, 0, n); }
+
+            /** collective append on a file shared by several processes:
+             * every process calls it, with its own n, and its items land
+             * after those of the processes before it
+             * @param before items appended by lower ranks in this call
+             * @param total items appended by all ranks in this call
+             */
+            void append(const T *data, hsize_t n, hsize_t before, hsize_t total) {
+                if (total == 0) return;
+                auto lk = lock();
+                int rank = static_cast<int>(item_.size()) + 1;
+                std::vector<hsize_t> dims(rank), start(rank, 0), count(rank);
+                dims[0] = count_ + total;
+                start[0] = count_ + before;
+                count[0] = n;
+                for (int d = 1; d < rank; d++) dims[d] = count[d] = item_[d - 1];
+
+                H5Dset_extent(dset_, dims.data());
+                hid_t fspace = H5Dget_space(dset_);
+                hid_t mspace = H5Screate_simple(rank, count.data(), NULL);
+                if (n > 0) {
+                    H5Sselect_hyperslab(fspace, H5S_SELECT_SET, start.data(),
+                        NULL, count.data(), NULL);
+                } else {
+                    // nothing from this rank, but it still joins the write
+                    H5Sselect_none(fspace);
+                    H5Sselect_none(mspace);
+                }
+                herr_t err = H5Dwrite(dset_, getH5Dtype<T>(), mspace, fspace,
+                    dxpl_, data);
+                H5Sclose(mspace);
+                H5Sclose(fspace);
+                if (err < 0) throw std::runtime_error("failed to append");
+                count_ += total;
+            }
+        };
+
         class Writer {
           private:
             hid_t file_;
+            hid_t dxpl_ = H5P_DEFAULT;
 
           public:
             Writer(const char *filename) {
+                auto lk = lock();
                 file_ = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT,
                     H5P_DEFAULT);
+                if (file_ < 0)
+                    throw std::runtime_error("failed to create file");
             }
 
-            ~Writer() { H5Fclose(file_); }
+#ifdef H5_HAVE_PARALLEL
+            /** create one file shared by every rank of comm (collective)
+             * Datasets are created collectively and appenders write with
+             * collective MPI-IO transfers.
+             */
+            Writer(const char *filename, MPI_Comm comm) {
+                auto lk = lock();
+                hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
+                H5Pset_fapl_mpio(fapl, comm, MPI_INFO_NULL);
+                file_ = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, fapl);
+                H5Pclose(fapl);
+                if (file_ < 0)
+                    throw std::runtime_error("failed to create file");
+                dxpl_ = H5Pcreate(H5P_DATASET_XFER);
+                H5Pset_dxpl_mpio(dxpl_, H5FD_MPIO_COLLECTIVE);
+            }
+#endif
+
+            ~Writer() {
+                auto lk = lock();
+                if (dxpl_ != H5P_DEFAULT) H5Pclose(dxpl_);
+                H5Fclose(file_);
+            }
+
+            template <typename T>
+            Appender<T> appender(const char *dataset_name,
+                std::vector<hsize_t> item, int deflate = 0) {
+                return Appender<T>(file_, dataset_name, std::move(item),
+                    deflate, dxpl_);
+            }
 
             template <typename T>
             void write(const char *dataset_name, const Array<T> &array) {
+                auto lk = lock();
                 hsize_t dims[3];
                 dims[0] = array.nslices();
                 dims[1] = array.nrows();
@@ -68,6 +202,7 @@ namespace tomocam {
 
             template <Complex T>
             void write(const char *dataset_name, const Array<T> &array) {
+                auto lk = lock();
                 hsize_t dims[3];
                 dims[0] = array.nslices();
                 dims[1] = array.nrows();
@@ -87,6 +222,7 @@ namespace tomocam {
 
             template <typename T>
             void write(const char *dataset_name, const std::vector<T> &array) {
+                auto lk = lock();
                 hsize_t dims[1];
                 dims[0] = array.size();
 
@@ -104,6 +240,7 @@ namespace tomocam {
 
             template <Complex T>
             void write(const char *dataset_name, const std::vector<T> &array) {
+                auto lk = lock();
                 hsize_t dims[1];
                 dims[0] = array.size();
 
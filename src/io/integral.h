@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "array.h"
+
+#ifndef TOMOCAM_INTEGRAL__H
+#define TOMOCAM_INTEGRAL__H
+
+namespace tomocam {
+
+    struct PatchStats {
+        double mean;
+        double variance;
+        double fg_fraction; // fraction of pixels above the foreground threshold
+    };
+
+    /** summed-area tables of one slice: sum, sum of squares and foreground
+     * count. Tables are (nrows + 1) x (ncols + 1) with a zero first row and
+     * column, so any rectangle costs four lookups per table. Storage is
+     * left uninitialized; the build writes every element once.
+     */
+    class IntegralImage {
+      private:
+        uint32_t nrows_;
+        uint32_t ncols_;
+        Array<double, alloc::Uninitialized> sum_;
+        Array<double, alloc::Uninitialized> sq_;
+        Array<uint32_t, alloc::Uninitialized> fg_;
+
+        size_t idx(uint32_t j, uint32_t k) const {
+            return static_cast<size_t>(j) * (ncols_ + 1) + k;
+        }
+
+        template <typename V>
+        V rect(const V *t, uint32_t y0, uint32_t x0, uint32_t y1,
+            uint32_t x1) const {
+            return t[idx(y1, x1)] - t[idx(y0, x1)] - t[idx(y1, x0)] +
+                   t[idx(y0, x0)];
+        }
+
+      public:
+        IntegralImage() : nrows_(0), ncols_(0) {}
+
+        /**
+         * @param s slice
+         * @param fg_threshold pixels strictly above this count as foreground
+         */
+        template <typename T>
+        IntegralImage(const Slice<T> &s, double fg_threshold) :
+            nrows_(s.nrows), ncols_(s.ncols),
+            sum_(1, s.nrows + 1, s.ncols + 1), sq_(sum_.dims()), fg_(sum_.dims()) {
+
+            uint32_t w = ncols_ + 1;
+            double *sum = sum_.begin();
+            double *sq = sq_.begin();
+            uint32_t *fg = fg_.begin();
+            std::fill_n(sum, w, 0.0);
+            std::fill_n(sq, w, 0.0);
+            std::fill_n(fg, w, 0u);
+
+            // pass 1: prefix sums along each row, rows are independent
+#pragma omp parallel for schedule(static)
+            for (int64_t j = 0; j < int64_t(nrows_); j++) {
+                const T *src = s.ptr + j * ncols_;
+                size_t o = idx(j + 1, 0);
+                double a = 0, b = 0;
+                uint32_t c = 0;
+                sum[o] = sq[o] = 0;
+                fg[o] = 0;
+                for (uint32_t k = 0; k < ncols_; k++) {
+                    double v = static_cast<double>(src[k]);
+                    a += v;
+                    b += v * v;
+                    c += (v > fg_threshold);
+                    sum[o + k + 1] = a;
+                    sq[o + k + 1] = b;
+                    fg[o + k + 1] = c;
+                }
+            }
+
+            // pass 2: accumulate down the columns, in column strips so each
+            // thread walks contiguous memory
+            constexpr uint32_t STRIP = 256;
+            int64_t nstrips = (w + STRIP - 1) / STRIP;
+#pragma omp parallel for schedule(static)
+            for (int64_t st = 0; st < nstrips; st++) {
+                uint32_t k0 = st * STRIP;
+                uint32_t k1 = std::min(w, k0 + STRIP);
+                for (uint32_t j = 2; j <= nrows_; j++) {
+                    size_t o = idx(j, 0);
+                    size_t p = idx(j - 1, 0);
+#pragma omp simd
+                    for (uint32_t k = k0; k < k1; k++) {
+                        sum[o + k] += sum[p + k];
+                        sq[o + k] += sq[p + k];
+                        fg[o + k] += fg[p + k];
+                    }
+                }
+            }
+        }
+
+        uint32_t nrows() const { return nrows_; }
+        uint32_t ncols() const { return ncols_; }
+
+        /** statistics of the ny x nx rectangle starting at (y0, x0), O(1)
+         */
+        PatchStats stats(uint32_t y0, uint32_t x0, uint32_t ny,
+            uint32_t nx) const {
+            uint32_t y1 = y0 + ny;
+            uint32_t x1 = x0 + nx;
+            double n = double(ny) * nx;
+            double s = rect(sum_.begin(), y0, x0, y1, x1);
+            double q = rect(sq_.begin(), y0, x0, y1, x1);
+            double f = rect(fg_.begin(), y0, x0, y1, x1);
+            double mean = s / n;
+            double var = std::max(0.0, q / n - mean * mean);
+            return {mean, var, f / n};
+        }
+    };
+
+    /** accept/reject rules for candidate patches
+     * A NaN fg_threshold picks the foreground threshold per slice with
+     * Otsu's method.
+     */
+    struct QualityFilter {
+        bool enabled = false;
+        double fg_threshold = NAN;
+        double min_fg_fraction = 0.5;
+        double min_mean = -INFINITY;
+        double max_mean = INFINITY;
+        double min_std = 0.0;
+        int max_attempts = 10; // candidates tried per requested patch
+
+        bool accept(const PatchStats &s) const {
+            return s.fg_fraction >= min_fg_fraction && s.mean >= min_mean &&
+                   s.mean <= max_mean && std::sqrt(s.variance) >= min_std;
+        }
+    };
+} // namespace tomocam
+#endif // TOMOCAM_INTEGRAL__H
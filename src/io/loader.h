@@ -1,7 +1,13 @@
 #include <filesystem>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 #include "array.h"
+#include "dtype.h"
 #include "hdf5/reader.h"
+#include "trace.h"
 #include "tiff/tiffio.h"
 
 #ifndef LOADER__H
@@ -10,14 +16,45 @@
 namespace fs = std::filesystem;
 
 namespace tomocam {
-    Array<float> loader(const std::string &filename) {
+    /** dataset read from an HDF5 file when none is named: "recon" if the
+     * file has it, else the first numeric 3D dataset in name order
+     */
+    inline std::string default_dataset(h5::Reader &reader) {
+        if (reader.exists("recon")) return "recon";
+        for (auto &info : reader.list())
+            if (info.volume()) return info.name;
+        throw std::runtime_error("no 3D dataset in file");
+    }
+
+    /** load a volume, or only a block of it
+     * @param filename .h5 or .tif/.tiff stack
+     * @param roi {slice, row, col} start and count, zero count for all
+     * @param ifds tiff page offsets from a preview sidecar, may be empty
+     * @param dataset HDF5 dataset, empty for default_dataset()
+     * @param progress called as slabs or pages arrive, false stops the read
+     * and leaves the rest of the volume unset
+     */
+    inline Array<float> loader(const std::string &filename, const Roi &roi = Roi{},
+                               const std::vector<uint64_t> &ifds = {},
+                               const std::string &dataset = {},
+                               const std::function<bool(double)> &progress = {}) {
+        TOMOCAM_TRACE_SCOPE("loader", "io");
         // check for file extension (h5 or tif)
         if (fs::path(filename).extension() == ".h5") {
-            auto reader = h5::Reader(filename.c_str());
-            return reader.read2<float>("recon");
+            h5::Reader reader(filename.c_str());
+            if (!reader.valid()) throw std::runtime_error("cannot open " + filename);
+            auto name = dataset.empty() ? default_dataset(reader) : dataset;
+            if (!reader.exists(name.c_str())) throw std::runtime_error("no dataset " + name);
+            // only checks that the stored type is a plain number; the
+            // library converts to float chunk by chunk as it reads
+            reader.dtype(name.c_str());
+            return reader.read_roi<float>(name.c_str(), roi, progress);
         } else if (fs::path(filename).extension() == ".tif" ||
                    fs::path(filename).extension() == ".tiff") {
-            return tiff::read<float>(filename);
+            return visit(tiff::dtype(filename), [&](auto tag) {
+                using T = typename decltype(tag)::type;
+                return tiff::read<T, float>(filename, roi, ifds, progress);
+            });
         } else {
             throw std::runtime_error("Unsupported file format: " +
                                      fs::path(filename).extension().string());
@@ -0,0 +1,272 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "array.h"
+#include "hdf5/reader.h"
+#include "hdf5/writer.h"
+#include "reductions.h"
+#include "tiff/tiffio.h"
+#include "trace.h"
+
+#ifndef TOMOCAM_PREVIEW__H
+#define TOMOCAM_PREVIEW__H
+
+namespace tomocam::preview {
+
+    /* Sidecar cache written next to a scan on its first open, so a reopen
+     * can show and scroll the volume before the full data is read.
+     *
+     * <scan>.tvpreview (HDF5, kept out of the *.h5 open filter)
+     *   key          uint64 {VERSION, file size, mtime}; any mismatch is a miss
+     *   dims         uint64 {slices, rows, cols} of the scan
+     *   slice_min, slice_max, slice_mean, slice_std    per-slice statistics
+     *   ifd_offsets  uint64, tiff page directory offsets (tiff only)
+     *   factors      uint64, downsampling factor of each level
+     *   level<i>     uint8 (slices, rows / f, cols / f), one chunk per slice
+     *
+     * Levels are normalized per slice with slice_min/slice_max, the
+     * finest has its longer side at most PREVIEW_SIDE.
+     */
+    constexpr uint64_t VERSION = 1;
+    constexpr uint32_t PREVIEW_SIDE = 512;
+    constexpr uint32_t MIN_SIDE = 64;
+
+    struct SliceStats {
+        float min;
+        float max;
+        double mean;
+        double stddev;
+    };
+
+    struct Sidecar {
+        std::vector<uint64_t> key;
+        dims_t dims{0, 0, 0};
+        std::vector<SliceStats> stats;
+        std::vector<uint64_t> ifds;
+        std::vector<uint32_t> factors;      // one per level, finest first
+        std::vector<Array<uint8_t>> levels; // load() returns a single level
+    };
+
+    inline std::string sidecar_path(const std::string &filename) {
+        return filename + ".tvpreview";
+    }
+
+    // version, size and modification time identify the scan contents
+    inline std::vector<uint64_t> file_key(const std::string &filename) {
+        namespace fs = std::filesystem;
+        auto size = fs::file_size(filename);
+        auto mtime = fs::last_write_time(filename).time_since_epoch().count();
+        return {VERSION, size, static_cast<uint64_t>(mtime)};
+    }
+
+    /** key and page index of a scan, taken before its data is read so a
+     * change during the read can not be cached under the new key
+     */
+    inline Sidecar probe(const std::string &filename) {
+        Sidecar s;
+        s.key = file_key(filename);
+        auto ext = std::filesystem::path(filename).extension();
+        if (ext == ".tif" || ext == ".tiff") s.ifds = tiff::ifd_offsets(filename);
+        return s;
+    }
+
+    namespace detail {
+        /** box-filter a float volume by f in y and x and quantize each slice
+         * to 8 bits with its own min/max
+         */
+        template <typename T>
+        Array<uint8_t> downsample(const Array<T> &vol, uint32_t f,
+            const std::vector<SliceStats> &stats) {
+            uint32_t ny = (vol.nrows() + f - 1) / f;
+            uint32_t nx = (vol.ncols() + f - 1) / f;
+            Array<uint8_t> out(vol.nslices(), ny, nx);
+
+#pragma omp parallel for collapse(2) schedule(static)
+            for (int64_t z = 0; z < int64_t(vol.nslices()); z++) {
+                for (int64_t y = 0; y < int64_t(ny); y++) {
+                    const SliceStats &st = stats[z];
+                    double scale = (st.max > st.min) ? 255.0 / (st.max - st.min) : 0.0;
+                    uint32_t y0 = y * f;
+                    uint32_t y1 = std::min(y0 + f, vol.nrows());
+                    uint8_t *row = out.begin() + out.flatIdx(z, y, 0);
+                    for (uint32_t x = 0; x < nx; x++) {
+                        uint32_t x0 = x * f;
+                        uint32_t x1 = std::min(x0 + f, vol.ncols());
+                        double sum = 0;
+                        for (uint32_t j = y0; j < y1; j++) {
+                            const T *src = vol.begin() + vol.flatIdx(z, j, 0);
+                            for (uint32_t k = x0; k < x1; k++) sum += src[k];
+                        }
+                        double mean = sum / (double(y1 - y0) * (x1 - x0));
+                        double v = std::clamp((mean - st.min) * scale, 0.0, 255.0);
+                        row[x] = static_cast<uint8_t>(v);
+                    }
+                }
+            }
+            return out;
+        }
+
+        // next pyramid level, 2 x 2 mean
+        inline Array<uint8_t> halve(const Array<uint8_t> &in) {
+            uint32_t ny = (in.nrows() + 1) / 2;
+            uint32_t nx = (in.ncols() + 1) / 2;
+            Array<uint8_t> out(in.nslices(), ny, nx);
+
+#pragma omp parallel for collapse(2) schedule(static)
+            for (int64_t z = 0; z < int64_t(in.nslices()); z++) {
+                for (int64_t y = 0; y < int64_t(ny); y++) {
+                    uint32_t y0 = 2 * y;
+                    uint32_t y1 = std::min(y0 + 2, in.nrows());
+                    uint8_t *row = out.begin() + out.flatIdx(z, y, 0);
+                    for (uint32_t x = 0; x < nx; x++) {
+                        uint32_t x0 = 2 * x;
+                        uint32_t x1 = std::min(x0 + 2, in.ncols());
+                        uint32_t sum = 0;
+                        for (uint32_t j = y0; j < y1; j++)
+                            for (uint32_t k = x0; k < x1; k++)
+                                sum += in[in.flatIdx(z, j, k)];
+                        uint32_t n = (y1 - y0) * (x1 - x0);
+                        row[x] = static_cast<uint8_t>((sum + n / 2) / n);
+                    }
+                }
+            }
+            return out;
+        }
+
+        inline std::string level_name(size_t i) { return "level" + std::to_string(i); }
+    } // namespace detail
+
+    /** fill in statistics and the preview pyramid of a loaded volume
+     * @param s sidecar from probe()
+     * @param vol full volume
+     * @param side longest side of the finest level
+     */
+    template <typename T>
+    void build(Sidecar &s, const Array<T> &vol, uint32_t side = PREVIEW_SIDE) {
+        TOMOCAM_TRACE_SCOPE("preview::build", "io");
+        s.dims = vol.dims();
+        s.stats.resize(vol.nslices());
+        for (uint32_t z = 0; z < vol.nslices(); z++) {
+            auto slc = vol.slice(z);
+            auto mm = reduce::minmax(slc);
+            auto mo = reduce::moments(slc);
+            s.stats[z] = {static_cast<float>(mm.min), static_cast<float>(mm.max),
+                mo.mean, std::sqrt(mo.variance)};
+        }
+
+        uint32_t longest = std::max(vol.nrows(), vol.ncols());
+        uint32_t f = 1;
+        while ((longest + f - 1) / f > side) f *= 2;
+
+        s.factors.clear();
+        s.levels.clear();
+        s.factors.push_back(f);
+        s.levels.push_back(detail::downsample(vol, f, s.stats));
+        while (std::max(s.levels.back().nrows(), s.levels.back().ncols()) / 2 >= MIN_SIDE) {
+            s.factors.push_back(s.factors.back() * 2);
+            s.levels.push_back(detail::halve(s.levels.back()));
+        }
+    }
+
+    /** write the sidecar of a scan
+     * The file is written under a temporary name and renamed into place,
+     * so a crash never leaves a truncated cache behind.
+     */
+    inline void save(const std::string &filename, const Sidecar &s) {
+        TOMOCAM_TRACE_SCOPE("preview::save", "io");
+        auto path = sidecar_path(filename);
+        auto tmp = path + ".tmp";
+        {
+            h5::Writer w(tmp.c_str());
+            w.write("key", s.key);
+            w.write("dims", std::vector<uint64_t>{s.dims.n0, s.dims.n1, s.dims.n2});
+
+            std::vector<float> mn, mx;
+            std::vector<double> mean, sd;
+            for (auto &st : s.stats) {
+                mn.push_back(st.min);
+                mx.push_back(st.max);
+                mean.push_back(st.mean);
+                sd.push_back(st.stddev);
+            }
+            w.write("slice_min", mn);
+            w.write("slice_max", mx);
+            w.write("slice_mean", mean);
+            w.write("slice_std", sd);
+            if (!s.ifds.empty()) w.write("ifd_offsets", s.ifds);
+            w.write("factors", std::vector<uint64_t>(s.factors.begin(), s.factors.end()));
+
+            for (size_t i = 0; i < s.levels.size(); i++) {
+                auto &lvl = s.levels[i];
+                auto out = w.appender<uint8_t>(detail::level_name(i).c_str(),
+                    {lvl.nrows(), lvl.ncols()}, 1);
+                out.append(lvl.begin(), lvl.nslices());
+            }
+        }
+        std::filesystem::rename(tmp, path);
+    }
+
+    /** read the sidecar of a scan if it is still current
+     * Only the finest level whose longer side fits max_side is read.
+     * @param filename scan, not the sidecar
+     * @param max_side longest side the preview will be shown at
+     * @return nothing when there is no sidecar or the scan has changed
+     */
+    inline std::optional<Sidecar> load(const std::string &filename,
+        uint32_t max_side = PREVIEW_SIDE) {
+        TOMOCAM_TRACE_SCOPE("preview::load", "io");
+        auto path = sidecar_path(filename);
+        std::error_code ec;
+        if (!std::filesystem::exists(path, ec)) return std::nullopt;
+
+        try {
+            h5::Reader r(path.c_str());
+            if (!r.valid() || !r.exists("key")) return std::nullopt;
+            Sidecar s;
+            s.key = r.read<uint64_t>("key");
+            if (s.key != file_key(filename)) return std::nullopt;
+
+            auto dims = r.read<uint64_t>("dims");
+            if (dims.size() != 3) return std::nullopt;
+            s.dims = dims_t{uint32_t(dims[0]), uint32_t(dims[1]), uint32_t(dims[2])};
+            auto mn = r.read<float>("slice_min");
+            auto mx = r.read<float>("slice_max");
+            auto mean = r.read<double>("slice_mean");
+            auto sd = r.read<double>("slice_std");
+            size_t n = dims[0];
+            if (mn.size() != n || mx.size() != n || mean.size() != n || sd.size() != n)
+                return std::nullopt;
+            s.stats.resize(mn.size());
+            for (size_t z = 0; z < mn.size(); z++) s.stats[z] = {mn[z], mx[z], mean[z], sd[z]};
+            if (r.exists("ifd_offsets")) s.ifds = r.read<uint64_t>("ifd_offsets");
+
+            // finest level that fits, else the coarsest one
+            auto factors = r.read<uint64_t>("factors");
+            if (factors.empty()) return std::nullopt;
+            for (auto f : factors)
+                if (f == 0) return std::nullopt;
+            uint32_t longest = std::max(s.dims.n1, s.dims.n2);
+            size_t pick = factors.size() - 1;
+            for (size_t i = 0; i < factors.size(); i++) {
+                if ((longest + factors[i] - 1) / factors[i] <= max_side) {
+                    pick = i;
+                    break;
+                }
+            }
+            if (!r.exists(detail::level_name(pick).c_str())) return std::nullopt;
+            s.factors = {static_cast<uint32_t>(factors[pick])};
+            s.levels.push_back(r.read2<uint8_t>(detail::level_name(pick).c_str()));
+            return s;
+        } catch (const std::exception &) {
+            // unreadable or stale layout: treat as a miss and rebuild
+            return std::nullopt;
+        }
+    }
+} // namespace tomocam::preview
+#endif // TOMOCAM_PREVIEW__H
@@ -0,0 +1,246 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifndef TOMOCAM_REDUCTIONS__H
+#define TOMOCAM_REDUCTIONS__H
+
+namespace tomocam::reduce {
+
+    /* Data is cut into fixed size chunks that are reduced independently
+     * (vectorized) and in parallel, then the per-chunk partials are combined
+     * in chunk order. The chunking does not depend on the thread count, so
+     * floating point results are the same for any OMP_NUM_THREADS.
+     */
+    constexpr size_t CHUNK = 1 << 16;
+
+    inline size_t nchunks(size_t n) { return (n + CHUNK - 1) / CHUNK; }
+
+    template <typename T>
+    struct MinMax {
+        T min;
+        T max;
+    };
+
+    struct Moments {
+        uint64_t count;
+        double sum;
+        double mean;
+        double variance; // population variance
+    };
+
+    struct Histogram {
+        double lo;
+        double hi;
+        std::vector<uint64_t> counts;
+        uint64_t below; // values < lo
+        uint64_t above; // values > hi, or NaN
+
+        double bin_width() const { return (hi - lo) / counts.size(); }
+    };
+
+    namespace detail {
+        template <typename T>
+        MinMax<T> minmax_chunk(const T *p, size_t n) {
+            T mn = p[0];
+            T mx = p[0];
+#pragma omp simd reduction(min : mn) reduction(max : mx)
+            for (size_t i = 0; i < n; i++) {
+                mn = std::min(mn, p[i]);
+                mx = std::max(mx, p[i]);
+            }
+            return {mn, mx};
+        }
+
+        // count, mean and sum of squared deviations of one chunk
+        struct Partial {
+            double n;
+            double mean;
+            double m2;
+        };
+
+        template <typename T>
+        Partial moments_chunk(const T *p, size_t n) {
+            double s = 0;
+#pragma omp simd reduction(+ : s)
+            for (size_t i = 0; i < n; i++) s += static_cast<double>(p[i]);
+            double mean = s / n;
+            double m2 = 0;
+#pragma omp simd reduction(+ : m2)
+            for (size_t i = 0; i < n; i++) {
+                double d = static_cast<double>(p[i]) - mean;
+                m2 += d * d;
+            }
+            return {static_cast<double>(n), mean, m2};
+        }
+
+        // Chan et al. pairwise update
+        inline Partial combine(const Partial &a, const Partial &b) {
+            if (a.n == 0) return b;
+            double n = a.n + b.n;
+            double d = b.mean - a.mean;
+            return {n, a.mean + d * b.n / n, a.m2 + b.m2 + d * d * a.n * b.n / n};
+        }
+    } // namespace detail
+
+    /** fused minimum and maximum in one pass
+     * @param p data
+     * @param n number of elements, must be > 0
+     */
+    template <typename T>
+    MinMax<T> minmax(const T *p, size_t n) {
+        if (n == 0) throw std::runtime_error("minmax of empty range");
+        int64_t nc = static_cast<int64_t>(nchunks(n));
+        std::vector<MinMax<T>> part(nc);
+#pragma omp parallel for schedule(static)
+        for (int64_t c = 0; c < nc; c++) {
+            size_t off = c * CHUNK;
+            part[c] = detail::minmax_chunk(p + off, std::min(CHUNK, n - off));
+        }
+        MinMax<T> r = part[0];
+        for (auto &m : part) {
+            r.min = std::min(r.min, m.min);
+            r.max = std::max(r.max, m.max);
+        }
+        return r;
+    }
+
+    /** count, sum, mean and population variance, accumulated in double
+     * @param p data
+     * @param n number of elements
+     */
+    template <typename T>
+    Moments moments(const T *p, size_t n) {
+        int64_t nc = static_cast<int64_t>(nchunks(n));
+        std::vector<detail::Partial> part(nc);
+#pragma omp parallel for schedule(static)
+        for (int64_t c = 0; c < nc; c++) {
+            size_t off = c * CHUNK;
+            part[c] = detail::moments_chunk(p + off, std::min(CHUNK, n - off));
+        }
+        detail::Partial r{0, 0, 0};
+        for (auto &q : part) r = detail::combine(r, q);
+        double var = (r.n > 0) ? r.m2 / r.n : 0;
+        return {n, r.mean * r.n, r.mean, var};
+    }
+
+    /** fixed-bin histogram over [lo, hi)
+     * @param p data
+     * @param n number of elements
+     * @param nbins number of bins
+     * @param lo lower edge of the first bin
+     * @param hi upper edge of the last bin; values == hi go into the last bin
+     */
+    template <typename T>
+    Histogram histogram(const T *p, size_t n, uint32_t nbins, double lo,
+        double hi) {
+        if (nbins == 0 || !(hi > lo))
+            throw std::runtime_error("invalid histogram range");
+
+        int nthreads = 1;
+#ifdef _OPENMP
+        nthreads = omp_get_max_threads();
+#endif
+        // one private histogram per thread, bins + below + above
+        std::vector<uint64_t> local(static_cast<size_t>(nthreads) * (nbins + 2), 0);
+        double scale = nbins / (hi - lo);
+        int64_t nc = static_cast<int64_t>(nchunks(n));
+
+#pragma omp parallel num_threads(nthreads)
+        {
+            int tid = 0;
+#ifdef _OPENMP
+            tid = omp_get_thread_num();
+#endif
+            uint64_t *h = local.data() + static_cast<size_t>(tid) * (nbins + 2);
+#pragma omp for schedule(static)
+            for (int64_t c = 0; c < nc; c++) {
+                size_t off = c * CHUNK;
+                size_t len = std::min(CHUNK, n - off);
+                for (size_t i = 0; i < len; i++) {
+                    double v = static_cast<double>(p[off + i]);
+                    if (v < lo) {
+                        h[nbins]++;
+                    } else if (!(v <= hi)) {
+                        h[nbins + 1]++;
+                    } else {
+                        auto b = static_cast<uint32_t>((v - lo) * scale);
+                        h[std::min(b, nbins - 1)]++;
+                    }
+                }
+            }
+        }
+
+        Histogram r{lo, hi, std::vector<uint64_t>(nbins, 0), 0, 0};
+        for (int t = 0; t < nthreads; t++) {
+            const uint64_t *h = local.data() + static_cast<size_t>(t) * (nbins + 2);
+            for (uint32_t b = 0; b < nbins; b++) r.counts[b] += h[b];
+            r.below += h[nbins];
+            r.above += h[nbins + 1];
+        }
+        return r;
+    }
+
+    /** Otsu's threshold: the bin edge maximizing between-class variance
+     * @param h histogram
+     * @return threshold in data units
+     */
+    inline double otsu_threshold(const Histogram &h) {
+        size_t nb = h.counts.size();
+        double total = 0, wsum = 0;
+        for (size_t b = 0; b < nb; b++) {
+            total += h.counts[b];
+            wsum += b * static_cast<double>(h.counts[b]);
+        }
+        double w0 = 0, s0 = 0, best = -1;
+        size_t cut = 0;
+        for (size_t b = 0; b + 1 < nb; b++) {
+            w0 += h.counts[b];
+            s0 += b * static_cast<double>(h.counts[b]);
+            double w1 = total - w0;
+            if (w0 == 0 || w1 == 0) continue;
+            double d = s0 / w0 - (wsum - s0) / w1;
+            double between = w0 * w1 * d * d;
+            if (between > best) {
+                best = between;
+                cut = b;
+            }
+        }
+        return h.lo + (cut + 1) * h.bin_width();
+    }
+
+    // overloads for anything with begin() and size(): Array, Slice
+    template <typename C>
+    auto minmax(const C &c) {
+        return minmax(c.begin(), c.size());
+    }
+
+    template <typename C>
+    Moments moments(const C &c) {
+        return moments(c.begin(), c.size());
+    }
+
+    template <typename C>
+    Histogram histogram(const C &c, uint32_t nbins, double lo, double hi) {
+        return histogram(c.begin(), c.size(), nbins, lo, hi);
+    }
+
+    // histogram over the full data range
+    template <typename C>
+    Histogram histogram(const C &c, uint32_t nbins) {
+        auto mm = minmax(c);
+        double lo = static_cast<double>(mm.min);
+        double hi = static_cast<double>(mm.max);
+        if (!(hi > lo)) hi = lo + 1;
+        return histogram(c.begin(), c.size(), nbins, lo, hi);
+    }
+} // namespace tomocam::reduce
+#endif // TOMOCAM_REDUCTIONS__H
@@ -0,0 +1,348 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dtype.h"
+
+#ifndef TOMOCAM_SHM_RING__H
+#define TOMOCAM_SHM_RING__H
+
+namespace tomocam::shm {
+
+    /* Items (e.g. patches) passed to another local process through a
+     * POSIX shared memory segment, without touching the disk. Every slot
+     * holds an item of up to the ring's item shape; each item carries its
+     * own shape, so patches of smaller scans share the ring.
+     *
+     * Layout, little endian, every offset is fixed so that readers in
+     * other languages (see python/tomoview_ring.py) can map it directly:
+     *
+     *   header, HEADER_BYTES
+     *     0  u64    magic "TOMORING"
+     *     8  u32    version
+     *    12  u32    header bytes (offset of slot 0)
+     *    16  u32    slot count, a power of two
+     *    20  u32    slot stride in bytes
+     *    24  u32    item capacity in bytes
+     *    28  u32    item ndim (<= 4)
+     *    32  u32[4] largest item shape
+     *    48  char[8] numpy dtype string, e.g. "<f4"
+     *    64  u64    head, next position claimed by a producer
+     *   128  u64    tail, next position to be read (informational)
+     *   192  u32    closed, set once no more items will be written
+     *   slot i at header bytes + i * stride
+     *     0  u64    sequence number
+     *     8  u32    payload bytes
+     *    16  i64[4] metadata, for patches {tag, slice, y0, x0}
+     *    48  u32[4] shape of this item, first ndim entries used
+     *    64  payload
+     *
+     * Queue protocol (bounded MPMC queue with per-slot sequence numbers,
+     * used here with many producers and one consumer). Slot i starts with
+     * sequence i. A producer at position p waits for slot p % n to carry
+     * sequence p, claims p by a CAS on head, fills the slot and publishes
+     * it by storing sequence p + 1. The consumer at position p waits for
+     * sequence p + 1, reads, and frees the slot by storing p + n. All
+     * shared words are naturally aligned 64-bit (32-bit for closed)
+     * values, so plain loads and stores are atomic on x86-64 and readers
+     * outside C++ need no atomics library.
+     */
+    constexpr uint64_t MAGIC = 0x474e49524f4d4f54; // "TOMORING"
+    constexpr uint32_t VERSION = 2;
+    constexpr uint32_t HEADER_BYTES = 4096;
+    constexpr uint32_t SLOT_HEADER_BYTES = 64;
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+    struct Header {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t header_bytes;
+        uint32_t slots;
+        uint32_t slot_stride;
+        uint32_t item_bytes;
+        uint32_t ndim;
+        uint32_t shape[4];
+        char dtype[8];
+        alignas(64) std::atomic<uint64_t> head;
+        alignas(64) std::atomic<uint64_t> tail;
+        alignas(64) std::atomic<uint32_t> closed;
+    };
+    static_assert(offsetof(Header, dtype) == 48 && offsetof(Header, head) == 64 &&
+                  offsetof(Header, tail) == 128 && offsetof(Header, closed) == 192);
+    static_assert(sizeof(Header) <= HEADER_BYTES);
+
+    struct SlotHeader {
+        std::atomic<uint64_t> seq;
+        uint32_t nbytes;
+        uint32_t reserved;
+        int64_t meta[4];
+        uint32_t shape[4];
+    };
+    static_assert(offsetof(SlotHeader, meta) == 16 && offsetof(SlotHeader, shape) == 48);
+    static_assert(sizeof(SlotHeader) <= SLOT_HEADER_BYTES);
+
+    using Meta = std::array<int64_t, 4>;
+    using Shape = std::array<uint32_t, 4>;
+
+    template <Sample T>
+    constexpr const char *numpy_dtype() {
+        return dtype_traits<T>::numpy;
+    }
+
+    // slot claimed by a producer or handed to the consumer
+    struct Slot {
+        uint64_t pos = 0;
+        SlotHeader *hdr = nullptr;
+        std::byte *data = nullptr;
+    };
+
+    namespace detail {
+        // spin briefly, then yield, then sleep; false once past the deadline
+        class Backoff {
+          private:
+            int n_ = 0;
+            std::chrono::steady_clock::time_point deadline_;
+
+          public:
+            explicit Backoff(std::chrono::milliseconds timeout) :
+                deadline_(std::chrono::steady_clock::now() + timeout) {}
+
+            bool wait() {
+                if (++n_ < 64) return true;
+                if (n_ < 128) {
+                    std::this_thread::yield();
+                    return true;
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+                return std::chrono::steady_clock::now() < deadline_;
+            }
+        };
+
+        inline std::runtime_error sys_error(const std::string &what) {
+            return std::runtime_error(what + ": " + std::strerror(errno));
+        }
+    } // namespace detail
+
+    /** mapping of a ring segment
+     * The process that create()s the segment owns it and unlinks the name
+     * when the Ring is destroyed; consumers open() it by name.
+     */
+    class Ring {
+      private:
+        std::string name_;
+        void *base_;
+        size_t bytes_;
+        bool owner_;
+
+        Ring(std::string name, void *base, size_t bytes, bool owner) :
+            name_(std::move(name)), base_(base), bytes_(bytes), owner_(owner) {}
+
+        static void *map(int fd, size_t bytes) {
+            void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (p == MAP_FAILED) throw detail::sys_error("mmap");
+            return p;
+        }
+
+      public:
+        /** create (or replace) a ring of slots items of the given shape
+         * @param name segment name, "/tomoview" style
+         * @param slots number of slots, rounded up to a power of two
+         * @param shape item shape, at most 4 dimensions
+         */
+        template <typename T>
+        static Ring create(const std::string &name, uint32_t slots, std::vector<uint32_t> shape) {
+            if (shape.empty() || shape.size() > 4) throw std::runtime_error("ring item must be 1 to 4D");
+            uint32_t n = 1;
+            while (n < slots) n *= 2;
+            size_t item = sizeof(T);
+            for (auto s : shape) item *= s;
+            size_t stride = (SLOT_HEADER_BYTES + item + 63) / 64 * 64;
+            size_t bytes = HEADER_BYTES + stride * n;
+
+            shm_unlink(name.c_str()); // a stale segment from a crashed run
+            int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+            if (fd < 0) throw detail::sys_error("shm_open " + name);
+            if (ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+                ::close(fd);
+                shm_unlink(name.c_str());
+                throw detail::sys_error("ftruncate " + name);
+            }
+            Ring ring(name, map(fd, bytes), bytes, true);
+
+            auto *h = new (ring.base_) Header{};
+            h->version = VERSION;
+            h->header_bytes = HEADER_BYTES;
+            h->slots = n;
+            h->slot_stride = static_cast<uint32_t>(stride);
+            h->item_bytes = static_cast<uint32_t>(item);
+            h->ndim = static_cast<uint32_t>(shape.size());
+            for (size_t d = 0; d < shape.size(); d++) h->shape[d] = shape[d];
+            std::strncpy(h->dtype, numpy_dtype<T>(), sizeof(h->dtype));
+            for (uint32_t i = 0; i < n; i++) new (ring.slot_header(i)) SlotHeader{{i}, 0, 0, {}, {}};
+            // magic last: a reader that sees it sees an initialized ring
+            std::atomic_thread_fence(std::memory_order_release);
+            h->magic = MAGIC;
+            return ring;
+        }
+
+        // attach to an existing ring, as the consumer
+        static Ring open(const std::string &name) {
+            int fd = shm_open(name.c_str(), O_RDWR, 0);
+            if (fd < 0) throw detail::sys_error("shm_open " + name);
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(HEADER_BYTES)) {
+                ::close(fd);
+                throw std::runtime_error("not a ring: " + name);
+            }
+            Ring ring(name, map(fd, st.st_size), st.st_size, false);
+            const Header *h = ring.header();
+            if (h->magic != MAGIC || h->version != VERSION)
+                throw std::runtime_error("not a ring: " + name);
+            return ring;
+        }
+
+        ~Ring() {
+            if (base_) munmap(base_, bytes_);
+            if (owner_) shm_unlink(name_.c_str());
+        }
+
+        Ring(const Ring &) = delete;
+        Ring &operator=(const Ring &) = delete;
+        Ring(Ring &&rhs) noexcept :
+            name_(std::move(rhs.name_)), base_(rhs.base_), bytes_(rhs.bytes_),
+            owner_(rhs.owner_) {
+            rhs.base_ = nullptr;
+            rhs.owner_ = false;
+        }
+
+        Header *header() const { return static_cast<Header *>(base_); }
+        uint32_t item_bytes() const { return header()->item_bytes; }
+        Shape item_shape() const {
+            Shape s{};
+            std::copy_n(header()->shape, 4, s.begin());
+            return s;
+        }
+        const std::string &name() const { return name_; }
+
+        SlotHeader *slot_header(uint64_t pos) const {
+            const Header *h = header();
+            auto *b = static_cast<std::byte *>(base_) + h->header_bytes +
+                      (pos & (h->slots - 1)) * h->slot_stride;
+            return reinterpret_cast<SlotHeader *>(b);
+        }
+
+        // producer side, safe from any number of threads and processes
+
+        /** claim the next free slot
+         * @return false if the consumer did not free one before the timeout
+         */
+        bool acquire(Slot &s, std::chrono::milliseconds timeout) {
+            Header *h = header();
+            detail::Backoff backoff(timeout);
+            uint64_t pos = h->head.load(std::memory_order_relaxed);
+            while (true) {
+                SlotHeader *sh = slot_header(pos);
+                uint64_t seq = sh->seq.load(std::memory_order_acquire);
+                int64_t diff = static_cast<int64_t>(seq - pos);
+                if (diff == 0) {
+                    if (h->head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        s = {pos, sh, reinterpret_cast<std::byte *>(sh) + SLOT_HEADER_BYTES};
+                        return true;
+                    }
+                } else if (diff < 0) {
+                    // full: wait for the consumer
+                    if (!backoff.wait()) return false;
+                    pos = h->head.load(std::memory_order_relaxed);
+                } else {
+                    pos = h->head.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // publish a filled slot holding an item of the given shape
+        void commit(Slot &s, uint32_t nbytes, const Meta &meta, const Shape &shape) {
+            s.hdr->nbytes = nbytes;
+            std::memcpy(s.hdr->meta, meta.data(), sizeof(s.hdr->meta));
+            std::memcpy(s.hdr->shape, shape.data(), sizeof(s.hdr->shape));
+            s.hdr->seq.store(s.pos + 1, std::memory_order_release);
+        }
+
+        // publish a filled slot holding a full-size item
+        void commit(Slot &s, uint32_t nbytes, const Meta &meta) {
+            commit(s, nbytes, meta, item_shape());
+        }
+
+        // copy one item in, false on timeout
+        bool push(const void *data, uint32_t nbytes, const Meta &meta,
+            std::chrono::milliseconds timeout) {
+            return push(data, nbytes, meta, item_shape(), timeout);
+        }
+
+        bool push(const void *data, uint32_t nbytes, const Meta &meta, const Shape &shape,
+            std::chrono::milliseconds timeout) {
+            if (nbytes > item_bytes()) throw std::runtime_error("item larger than ring slot");
+            Slot s;
+            if (!acquire(s, timeout)) return false;
+            std::memcpy(s.data, data, nbytes);
+            commit(s, nbytes, meta, shape);
+            return true;
+        }
+
+        // no more items; the consumer stops once it has drained the ring
+        void close() { header()->closed.store(1, std::memory_order_release); }
+
+        // consumer side, a single thread
+
+        /** wait for the next item
+         * @return false on timeout, or when the ring is closed and drained
+         */
+        bool read(Slot &s, std::chrono::milliseconds timeout) {
+            Header *h = header();
+            uint64_t pos = h->tail.load(std::memory_order_relaxed);
+            SlotHeader *sh = slot_header(pos);
+            detail::Backoff backoff(timeout);
+            while (sh->seq.load(std::memory_order_acquire) != pos + 1) {
+                if (h->closed.load(std::memory_order_acquire) &&
+                    h->head.load(std::memory_order_acquire) == pos)
+                    return false;
+                if (!backoff.wait()) return false;
+            }
+            s = {pos, sh, reinterpret_cast<std::byte *>(sh) + SLOT_HEADER_BYTES};
+            return true;
+        }
+
+        // hand the slot back to the producers
+        void release(Slot &s) {
+            Header *h = header();
+            s.hdr->seq.store(s.pos + h->slots, std::memory_order_release);
+            h->tail.store(s.pos + 1, std::memory_order_relaxed);
+        }
+
+        // closed and nothing left to read
+        bool finished() const {
+            const Header *h = header();
+            return h->closed.load(std::memory_order_acquire) &&
+                   h->head.load(std::memory_order_acquire) ==
+                       h->tail.load(std::memory_order_relaxed);
+        }
+    };
+} // namespace tomocam::shm
+#endif // TOMOCAM_SHM_RING__H
@@ -0,0 +1,255 @@
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "array.h"
+#include "trace.h"
+
+#ifndef TOMOCAM_SLICE_CACHE__H
+#define TOMOCAM_SLICE_CACHE__H
+
+namespace tomocam {
+
+    /* Concurrent cache of 2D slices. The viewer keeps its 8-bit display
+     * slices here, so rendering and the prefetcher share one resident
+     * working set. Exports do not go through it: they read the float
+     * stack, which is already in memory, or stream slabs from the file.
+     *
+     * Lookups lock one of SHARDS shards, picked by key hash. A slice is
+     * filled once: the first get() of a key fills it, concurrent get()s of
+     * the same key wait for that fill (single flight). get() returns a
+     * pinned handle; pinned slices are never evicted. Once the resident
+     * bytes exceed the budget, unpinned slices are evicted in CLOCK order,
+     * a slice read since the hand last passed gets a second chance.
+     */
+
+    struct SliceKey {
+        uint64_t volume; // caller's id for the volume, e.g. a load generation
+        uint32_t slice;
+        bool operator==(const SliceKey &) const = default;
+    };
+
+    struct CacheStats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        uint64_t bytes;   // resident
+        uint64_t entries; // resident or being filled
+    };
+
+    template <typename T>
+    class SliceCache {
+      private:
+        static constexpr size_t SHARDS = 16;
+
+        struct Entry {
+            SliceKey key;
+            std::vector<T> data;
+            uint32_t nrows;
+            uint32_t ncols;
+            std::shared_future<void> ready;
+            std::atomic<uint32_t> pins{1};        // the filling get() holds one
+            std::atomic<bool> referenced{true};   // CLOCK bit
+            bool filled{false};                   // under the shard lock
+        };
+        using EntryPtr = std::shared_ptr<Entry>;
+
+        struct KeyHash {
+            size_t operator()(const SliceKey &k) const {
+                uint64_t h = k.volume * 0x9e3779b97f4a7c15ull ^ k.slice;
+                return static_cast<size_t>(h ^ (h >> 29));
+            }
+        };
+
+        struct Shard {
+            std::mutex mtx;
+            std::list<EntryPtr> ring; // CLOCK order
+            typename std::list<EntryPtr>::iterator hand{ring.end()};
+            std::unordered_map<SliceKey, typename std::list<EntryPtr>::iterator, KeyHash> index;
+        };
+
+        uint64_t budget_;
+        std::unique_ptr<Shard[]> shards_;
+        std::atomic<uint64_t> bytes_{0};
+        std::atomic<uint64_t> entries_{0};
+        std::atomic<uint64_t> hits_{0};
+        std::atomic<uint64_t> misses_{0};
+        std::atomic<uint64_t> evictions_{0};
+        std::atomic<size_t> next_shard_{0};
+
+        Shard &shard(const SliceKey &k) { return shards_[KeyHash{}(k) % SHARDS]; }
+
+        // caller holds s.mtx
+        void erase(Shard &s, typename std::list<EntryPtr>::iterator it) {
+            if (s.hand == it) ++s.hand;
+            if ((*it)->filled) bytes_ -= (*it)->data.size() * sizeof(T);
+            s.index.erase((*it)->key);
+            s.ring.erase(it);
+            entries_--;
+        }
+
+        // one CLOCK sweep of a shard, two passes at most; true if a slice went
+        bool evict_one(Shard &s) {
+            std::lock_guard<std::mutex> lock(s.mtx);
+            for (size_t n = 0; n < 2 * s.ring.size(); n++) {
+                if (s.hand == s.ring.end()) s.hand = s.ring.begin();
+                auto it = s.hand;
+                Entry &e = **it;
+                ++s.hand;
+                if (!e.filled || e.pins.load(std::memory_order_acquire) > 0) continue;
+                if (e.referenced.exchange(false, std::memory_order_relaxed)) continue;
+                erase(s, it);
+                evictions_++;
+                return true;
+            }
+            return false;
+        }
+
+        // evict until under budget or everything left is pinned
+        void shrink() {
+            size_t idle = 0;
+            while (bytes_ > budget_ && idle < SHARDS) {
+                Shard &s = shards_[next_shard_.fetch_add(1, std::memory_order_relaxed) % SHARDS];
+                idle = evict_one(s) ? 0 : idle + 1;
+            }
+        }
+
+      public:
+        /** pinned, read-only slice; the slice stays resident while held */
+        class Handle {
+          private:
+            EntryPtr e_;
+
+          public:
+            Handle() = default;
+            explicit Handle(EntryPtr e) : e_(std::move(e)) {}
+            ~Handle() { reset(); }
+            Handle(const Handle &rhs) : e_(rhs.e_) {
+                if (e_) e_->pins++;
+            }
+            Handle &operator=(const Handle &rhs) {
+                if (this != &rhs) {
+                    reset();
+                    e_ = rhs.e_;
+                    if (e_) e_->pins++;
+                }
+                return *this;
+            }
+            Handle(Handle &&) noexcept = default;
+            Handle &operator=(Handle &&rhs) noexcept {
+                if (this != &rhs) {
+                    reset();
+                    e_ = std::move(rhs.e_);
+                }
+                return *this;
+            }
+
+            void reset() {
+                if (e_) e_->pins.fetch_sub(1, std::memory_order_release);
+                e_.reset();
+            }
+            explicit operator bool() const { return e_ != nullptr; }
+            View2D<T> view() const { return {e_->nrows, e_->ncols, e_->ncols, e_->data.data()}; }
+        };
+
+        /** @param budget resident bytes kept before unpinned slices are evicted */
+        explicit SliceCache(uint64_t budget) : budget_(budget), shards_(new Shard[SHARDS]) {}
+
+        SliceCache(const SliceCache &) = delete;
+        SliceCache &operator=(const SliceCache &) = delete;
+
+        /** pinned slice for key, filled on a miss
+         * @param nrows, ncols shape of the slice
+         * @param fill writes the slice into a Slice<T> of that shape; called
+         * once per key, exceptions reach every waiting caller and the key
+         * is dropped so a later get() tries again
+         */
+        template <typename F>
+        Handle get(const SliceKey &key, uint32_t nrows, uint32_t ncols, F &&fill) {
+            Shard &s = shard(key);
+            EntryPtr e;
+            std::promise<void> done;
+            bool owner = false;
+            {
+                std::lock_guard<std::mutex> lock(s.mtx);
+                auto it = s.index.find(key);
+                if (it != s.index.end()) {
+                    e = *it->second;
+                    e->pins++;
+                    e->referenced.store(true, std::memory_order_relaxed);
+                    hits_++;
+                } else {
+                    e = std::make_shared<Entry>();
+                    e->key = key;
+                    e->nrows = nrows;
+                    e->ncols = ncols;
+                    e->ready = done.get_future().share();
+                    s.index.emplace(key, s.ring.insert(s.hand, e));
+                    entries_++;
+                    misses_++;
+                    owner = true;
+                }
+            }
+            Handle h(e);
+            if (!owner) {
+                e->ready.get(); // rethrows a failed fill
+                return h;
+            }
+
+            try {
+                TOMOCAM_TRACE_SCOPE("cache_fill", "io");
+                e->data.resize(size_t(nrows) * ncols);
+                fill(Slice<T>{nrows, ncols, e->data.data()});
+            } catch (...) {
+                {
+                    std::lock_guard<std::mutex> lock(s.mtx);
+                    auto it = s.index.find(key);
+                    if (it != s.index.end() && *it->second == e) erase(s, it->second);
+                }
+                done.set_exception(std::current_exception());
+                throw;
+            }
+            {
+                std::lock_guard<std::mutex> lock(s.mtx);
+                e->filled = true;
+                bytes_ += e->data.size() * sizeof(T);
+            }
+            done.set_value();
+            shrink();
+            return h;
+        }
+
+        // resident or being filled; not counted as a lookup
+        bool contains(const SliceKey &key) {
+            Shard &s = shard(key);
+            std::lock_guard<std::mutex> lock(s.mtx);
+            return s.index.count(key) > 0;
+        }
+
+        // drop every unpinned slice of a volume, e.g. when it is replaced
+        void drop(uint64_t volume) {
+            for (size_t i = 0; i < SHARDS; i++) {
+                Shard &s = shards_[i];
+                std::lock_guard<std::mutex> lock(s.mtx);
+                for (auto it = s.ring.begin(); it != s.ring.end();) {
+                    auto next = std::next(it);
+                    Entry &e = **it;
+                    if (e.key.volume == volume && e.filled && e.pins.load() == 0) erase(s, it);
+                    it = next;
+                }
+            }
+        }
+
+        CacheStats stats() const {
+            return {hits_.load(), misses_.load(), evictions_.load(), bytes_.load(), entries_.load()};
+        }
+        uint64_t budget() const { return budget_; }
+    };
+} // namespace tomocam
+#endif // TOMOCAM_SLICE_CACHE__H
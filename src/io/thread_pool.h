@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#ifndef TOMOCAM_THREAD_POOL__H
+#define TOMOCAM_THREAD_POOL__H
+
+namespace tomocam {
+
+    /** fixed size pool of worker threads
+     * Tasks run in submission order; exceptions thrown by a task are
+     * delivered through the returned future.
+     */
+    class ThreadPool {
+      private:
+        std::vector<std::thread> workers_;
+        std::queue<std::function<void()>> tasks_;
+        std::mutex mtx_;
+        std::condition_variable cv_;
+        bool stop_;
+
+        void run() {
+            while (true) {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(mtx_);
+                    cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+                    if (stop_ && tasks_.empty()) return;
+                    task = std::move(tasks_.front());
+                    tasks_.pop();
+                }
+                task();
+            }
+        }
+
+      public:
+        ThreadPool(size_t nthreads = 0) : stop_(false) {
+            if (nthreads == 0)
+                nthreads = std::max(1u, std::thread::hardware_concurrency());
+            workers_.reserve(nthreads);
+            for (size_t i = 0; i < nthreads; i++)
+                workers_.emplace_back([this] { run(); });
+        }
+
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                stop_ = true;
+            }
+            cv_.notify_all();
+            for (auto &w : workers_) w.join();
+        }
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        size_t size() const { return workers_.size(); }
+
+        template <typename F>
+        auto submit(F &&f) -> std::future<std::invoke_result_t<F>> {
+            using R = std::invoke_result_t<F>;
+            auto task =
+                std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+            auto fut = task->get_future();
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                tasks_.emplace([task] { (*task)(); });
+            }
+            cv_.notify_one();
+            return fut;
+        }
+    };
+} // namespace tomocam
+#endif // TOMOCAM_THREAD_POOL__H
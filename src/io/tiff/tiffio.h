@@ -1,114 +1,403 @@
 // #include <concepts>
+#include <algorithm>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
 #include <stdexcept>
+#include <string>
 #include <tiff.h>
 #include <tiffio.h>
 #include <type_traits>
+#include <vector>
 
 #include "../array.h"
+#include "../dtype.h"
+#include "../thread_pool.h"
+#include "../trace.h"
 
 #ifndef TIFFIO__H
 #define TIFFIO__H
 
 namespace tomocam::tiff {
 
-    template <typename T>
-    concept single32_t =
-        std::is_same_v<T, float> || std::is_same_v<T, uint32_t>;
+    enum class Compression { None, LZW, Deflate, Zstd };
 
-    template <typename single32_t>
-    inline Array<single32_t> read(std::string filename) {
+    struct WriteOptions {
+        Compression compression = Compression::None;
+        bool predictor = true;      // only used with compression
+        int level = 0;              // Deflate/Zstd level, 0 for the default
+        uint32_t rows_per_strip = 0; // 0 picks ~256 KB strips
+    };
 
-        TIFF *tif_ = TIFFOpen(filename.c_str(), "r");
+    namespace detail {
+        constexpr uint32_t STRIP_BYTES = 1 << 18;
 
-        // count number of projections
-        uint32_t npages = 0;
-        do { npages++; } while (TIFFReadDirectory(tif_));
+        template <Sample T>
+        constexpr uint16_t sample_format() {
+            constexpr Kind k = dtype_traits<T>::kind;
+            if constexpr (k == Kind::Float)
+                return SAMPLEFORMAT_IEEEFP;
+            else if constexpr (k == Kind::Signed)
+                return SAMPLEFORMAT_INT;
+            else
+                return SAMPLEFORMAT_UINT;
+        }
 
-        // get image size
-        uint16_t bits, format;
-        uint32_t w, h;
-        TIFFGetField(tif_, TIFFTAG_IMAGEWIDTH, &w);
-        TIFFGetField(tif_, TIFFTAG_IMAGELENGTH, &h);
-        TIFFGetField(tif_, TIFFTAG_BITSPERSAMPLE, &bits);
-        TIFFGetField(tif_, TIFFTAG_SAMPLEFORMAT, &format);
+        // sample type of the current page
+        inline DType page_dtype(TIFF *tif) {
+            uint16_t bits = 0, format = SAMPLEFORMAT_UINT, spp = 1;
+            TIFFGetFieldDefaulted(tif, TIFFTAG_BITSPERSAMPLE, &bits);
+            TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLEFORMAT, &format);
+            TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLESPERPIXEL, &spp);
+            if (spp != 1) throw std::runtime_error("only single channel tiff is supported");
+            Kind k = format == SAMPLEFORMAT_IEEEFP ? Kind::Float
+                     : format == SAMPLEFORMAT_INT  ? Kind::Signed
+                                                   : Kind::Unsigned;
+            return dtype_of(k, bits);
+        }
 
-        if (format != SAMPLEFORMAT_IEEEFP && format != SAMPLEFORMAT_UINT) {
-            throw std::runtime_error("unsupported data type");
+        inline uint16_t codec(Compression c) {
+            switch (c) {
+            case Compression::LZW:
+                return COMPRESSION_LZW;
+            case Compression::Deflate:
+                return COMPRESSION_ADOBE_DEFLATE;
+            case Compression::Zstd:
+                return COMPRESSION_ZSTD;
+            default:
+                return COMPRESSION_NONE;
+            }
         }
 
-        // allocate memory
-        uint32_t nscls = static_cast<uint32_t>(npages);
-        uint32_t nrows = static_cast<uint32_t>(w);
-        uint32_t ncols = static_cast<uint32_t>(h);
-        Array<single32_t> data(nscls, nrows, ncols);
+        template <typename T>
+        uint32_t rows_per_strip(uint32_t width, uint32_t height,
+            const WriteOptions &opts) {
+            if (opts.rows_per_strip > 0)
+                return std::min(opts.rows_per_strip, height);
+            uint32_t rps = STRIP_BYTES / (width * sizeof(T));
+            return std::clamp(rps, 1u, height);
+        }
 
-        single32_t *buf = (single32_t *)_TIFFmalloc(w * sizeof(single32_t));
+        // tags for one page, followed by TIFFWriteEncodedStrip calls
+        template <typename T>
+        void set_tags(TIFF *tif, uint32_t width, uint32_t height,
+            uint32_t rps, const WriteOptions &opts) {
+            uint16_t comp = codec(opts.compression);
+            TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width);
+            TIFFSetField(tif, TIFFTAG_IMAGELENGTH, height);
+            TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+            TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8 * sizeof(T));
+            TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, sample_format<T>());
+            TIFFSetField(tif, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
+            TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+            TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+            TIFFSetField(tif, TIFFTAG_COMPRESSION, comp);
+            TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, rps);
+            if (comp == COMPRESSION_NONE) return;
 
-        tsize_t line_size = TIFFScanlineSize(tif_);
-        if (line_size != (w * sizeof(single32_t))) {
-            std::cerr << "Error: line_size, width mismatch" << std::endl;
-            exit(1);
+            if (opts.predictor) {
+                uint16_t pred = std::is_floating_point_v<T>
+                                    ? PREDICTOR_FLOATINGPOINT
+                                    : PREDICTOR_HORIZONTAL;
+                TIFFSetField(tif, TIFFTAG_PREDICTOR, pred);
+            }
+            if (opts.level > 0) {
+                if (comp == COMPRESSION_ADOBE_DEFLATE)
+                    TIFFSetField(tif, TIFFTAG_ZIPQUALITY, opts.level);
+                else if (comp == COMPRESSION_ZSTD)
+                    TIFFSetField(tif, TIFFTAG_ZSTD_LEVEL, opts.level);
+            }
         }
 
-        for (uint32_t i = 0; i < nscls; i++) {
-            TIFFSetDirectory(tif_, static_cast<tdir_t>(i));
-            for (uint32_t j = 0; j < h; j++) {
-                if (TIFFReadScanline(tif_, buf, static_cast<uint32_t>(j)) < 0) {
-                    std::cerr << "Error: failed to read scanline: " << i
-                              << std::endl;
-                    exit(1);
+        /** write one page strip by strip straight from the source rows
+         * The source is handed to libtiff without a copy when it is
+         * contiguous and no predictor is used; the predictor runs in place
+         * on the strip buffer, so in that case (and for strided views) rows
+         * are memcpy'd into a scratch strip first.
+         */
+        template <typename T>
+        void write_page(TIFF *tif, const View2D<T> &img,
+            const WriteOptions &opts) {
+            if (img.nrows == 0 || img.ncols == 0)
+                throw std::runtime_error("cannot write an empty image");
+            uint32_t rps = rows_per_strip<T>(img.ncols, img.nrows, opts);
+            set_tags<T>(tif, img.ncols, img.nrows, rps, opts);
+
+            bool in_place = opts.predictor &&
+                            opts.compression != Compression::None;
+            bool direct = img.contiguous() && !in_place;
+            std::vector<T> scratch;
+            if (!direct) scratch.resize(static_cast<size_t>(rps) * img.ncols);
+
+            uint32_t nstrips = (img.nrows + rps - 1) / rps;
+            for (uint32_t s = 0; s < nstrips; s++) {
+                uint32_t r0 = s * rps;
+                uint32_t nr = std::min(rps, img.nrows - r0);
+                tmsize_t nbytes =
+                    static_cast<tmsize_t>(nr) * img.ncols * sizeof(T);
+                void *buf;
+                if (direct) {
+                    buf = const_cast<T *>(img.row(r0));
+                } else {
+                    for (uint32_t j = 0; j < nr; j++)
+                        std::memcpy(scratch.data() + j * img.ncols,
+                            img.row(r0 + j), img.ncols * sizeof(T));
+                    buf = scratch.data();
                 }
-                for (uint32_t k = 0; k < ncols; k++) data[{i, j, k}] = buf[k];
+                if (TIFFWriteEncodedStrip(tif, s, buf, nbytes) < 0)
+                    throw std::runtime_error("failed to write tiff strip");
             }
+            if (!TIFFWriteDirectory(tif))
+                throw std::runtime_error("failed to write tiff directory");
         }
-        _TIFFfree(buf);
-        TIFFClose(tif_);
-        return data;
+
+        using tiff_ptr = std::unique_ptr<TIFF, decltype(&TIFFClose)>;
+
+        inline tiff_ptr open_for_write(const std::string &filename,
+            const WriteOptions &opts) {
+            uint16_t comp = codec(opts.compression);
+            if (!TIFFIsCODECConfigured(comp))
+                throw std::runtime_error("tiff codec not available in libtiff");
+            TIFF *tif = TIFFOpen(filename.c_str(), "w");
+            if (!tif)
+                throw std::runtime_error("failed to open " + filename);
+            return tiff_ptr(tif, &TIFFClose);
+        }
+    } // namespace detail
+
+    /** write a 2D (possibly strided) view as a single page tiff
+     * @param filename output file
+     * @param img view into the source memory
+     * @param opts compression and strip layout
+     */
+    template <typename T>
+    inline void write(std::string filename, const View2D<T> &img,
+        const WriteOptions &opts = {}) {
+        TOMOCAM_TRACE_SCOPE("tiff::write", "io");
+        auto tif = detail::open_for_write(filename, opts);
+        detail::write_page(tif.get(), img, opts);
+    }
+
+    template <Sample T>
+    inline void write(std::string filename, const Array<T> &data,
+        const WriteOptions &opts = {}) {
+        TOMOCAM_TRACE_SCOPE("tiff::write", "io");
+        auto tif = detail::open_for_write(filename, opts);
+        for (uint32_t i = 0; i < data.nslices(); i++)
+            detail::write_page(tif.get(),
+                data.view(i, 0, 0, data.nrows(), data.ncols()), opts);
     }
 
-    template <typename single32_t>
-    inline void write(std::string filename, const Array<single32_t> &data) {
+    namespace detail {
+        // growable in-memory file behind TIFFClientOpen
+        struct MemStream {
+            std::vector<uint8_t> buf;
+            toff_t pos = 0;
+        };
 
-        // open file
-        TIFF *tif_ = TIFFOpen(filename.c_str(), "w");
+        inline tmsize_t mem_read(thandle_t h, void *p, tmsize_t n) {
+            auto *ms = static_cast<MemStream *>(h);
+            if (ms->pos >= ms->buf.size()) return 0;
+            tmsize_t avail = static_cast<tmsize_t>(ms->buf.size() - ms->pos);
+            n = std::min(n, avail);
+            std::memcpy(p, ms->buf.data() + ms->pos, n);
+            ms->pos += n;
+            return n;
+        }
+
+        inline tmsize_t mem_write(thandle_t h, void *p, tmsize_t n) {
+            auto *ms = static_cast<MemStream *>(h);
+            if (ms->pos + n > ms->buf.size()) ms->buf.resize(ms->pos + n);
+            std::memcpy(ms->buf.data() + ms->pos, p, n);
+            ms->pos += n;
+            return n;
+        }
 
-        uint32_t npages = static_cast<uint32_t>(data.nslices());
-        uint32_t height = static_cast<uint32_t>(data.nrows());
-        uint32_t width = static_cast<uint32_t>(data.ncols());
+        inline toff_t mem_seek(thandle_t h, toff_t off, int whence) {
+            auto *ms = static_cast<MemStream *>(h);
+            if (whence == SEEK_CUR)
+                ms->pos += off;
+            else if (whence == SEEK_END)
+                ms->pos = ms->buf.size() + off;
+            else
+                ms->pos = off;
+            return ms->pos;
+        }
 
-        single32_t *buf = (single32_t *)_TIFFmalloc(sizeof(single32_t) * width);
+        inline int mem_close(thandle_t) { return 0; }
+        inline toff_t mem_size(thandle_t h) {
+            return static_cast<MemStream *>(h)->buf.size();
+        }
+        inline int mem_map(thandle_t, void **, toff_t *) { return 0; }
+        inline void mem_unmap(thandle_t, void *, toff_t) {}
+    } // namespace detail
 
-        for (uint32_t i = 0; i < npages; i++) {
-            TIFFSetField(tif_, TIFFTAG_IMAGEWIDTH, width);
-            TIFFSetField(tif_, TIFFTAG_IMAGELENGTH, height);
-            TIFFSetField(tif_, TIFFTAG_SAMPLESPERPIXEL, 1);
-            TIFFSetField(tif_, TIFFTAG_BITSPERSAMPLE, 32);
-            if (std::is_same_v<single32_t, float>) {
-                TIFFSetField(tif_, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_IEEEFP);
-            } else {
-                TIFFSetField(tif_, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
-            }
-            TIFFSetField(tif_, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
-            TIFFSetField(tif_, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
-            TIFFSetField(tif_, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
-            TIFFSetField(tif_, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
-            TIFFSetField(tif_, TIFFTAG_ROWSPERSTRIP, height); // one strip
-
-            for (uint32_t j = 0; j < height; j++) {
-                for (uint32_t k = 0; k < width; k++) buf[k] = data[{i, j, k}];
-
-                if (TIFFWriteScanline(tif_, buf, j) < 0) {
-                    std::cerr << "Error wrtiting data to tif file."
-                              << std::endl;
-                    std::exit(2);
+    /** encode a view as a complete single page tiff file in memory
+     * @param img view into the source memory
+     * @param opts compression and strip layout
+     * @return bytes of the tiff file
+     */
+    template <typename T>
+    inline std::vector<uint8_t> encode(const View2D<T> &img,
+        const WriteOptions &opts = {}) {
+        TOMOCAM_TRACE_SCOPE("tiff::encode", "io");
+        if (!TIFFIsCODECConfigured(detail::codec(opts.compression)))
+            throw std::runtime_error("tiff codec not available in libtiff");
+
+        detail::MemStream ms;
+        ms.buf.reserve(static_cast<size_t>(img.nrows) * img.ncols * sizeof(T) +
+                       1024);
+        TIFF *tif = TIFFClientOpen("memory", "wm", &ms, detail::mem_read,
+            detail::mem_write, detail::mem_seek, detail::mem_close,
+            detail::mem_size, detail::mem_map, detail::mem_unmap);
+        if (!tif) throw std::runtime_error("failed to open in-memory tiff");
+        detail::tiff_ptr guard(tif, &TIFFClose);
+        detail::write_page(tif, img, opts);
+        guard.reset(); // flushes the directory into ms
+        return std::move(ms.buf);
+    }
+
+    /** encode and write a view on a worker thread
+     * The view must stay valid until the returned future is ready.
+     */
+    template <typename T>
+    inline std::future<void> write_async(ThreadPool &pool,
+        std::string filename, View2D<T> img, WriteOptions opts = {}) {
+        return pool.submit([filename = std::move(filename), img, opts] {
+            write(filename, img, opts);
+        });
+    }
+    namespace detail {
+        /** decode the strips of the current page that overlap the ROI rows
+         * and copy the ROI columns into out (count.n1 x count.n2),
+         * converting each sample from T to Out
+         */
+        template <typename T, typename Out>
+        void read_page(TIFF *tif, const Roi &roi, Out *out, std::vector<T> &strip,
+            uint32_t width) {
+            uint32_t rps = 0, height = 0;
+            TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &rps);
+            TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &height);
+            uint32_t y0 = roi.start.n1;
+            uint32_t y1 = y0 + roi.count.n1;
+            uint32_t x0 = roi.start.n2;
+            uint32_t nx = roi.count.n2;
+            // without the tag the default is 2^32-1: the page is one strip
+            rps = std::clamp(rps, 1u, std::max(1u, height));
+            strip.resize(static_cast<size_t>(rps) * width);
+
+            for (uint32_t s = y0 / rps; s * rps < y1; s++) {
+                tmsize_t n = TIFFReadEncodedStrip(tif, s, strip.data(),
+                    static_cast<tmsize_t>(strip.size() * sizeof(T)));
+                if (n < 0) throw std::runtime_error("failed to read tiff strip");
+                uint32_t r0 = std::max(y0, s * rps);
+                uint32_t r1 = std::min(y1, (s + 1) * rps);
+                for (uint32_t r = r0; r < r1; r++) {
+                    Out *dst = out + static_cast<size_t>(r - y0) * nx;
+                    const T *src = strip.data() + static_cast<size_t>(r - s * rps) * width + x0;
+                    if constexpr (std::is_same_v<T, Out>) {
+                        std::memcpy(dst, src, nx * sizeof(T));
+                    } else {
+                        for (uint32_t x = 0; x < nx; x++) dst[x] = static_cast<Out>(src[x]);
+                    }
                 }
             }
-            TIFFWriteDirectory(tif_);
         }
-        _TIFFfree(buf);
-        TIFFClose(tif_);
+    } // namespace detail
+
+    /** byte offset of every page directory, in page order
+     * Kept in the preview sidecar so later opens can seek straight to a
+     * page instead of walking the IFD chain.
+     */
+    inline std::vector<uint64_t> ifd_offsets(const std::string &filename) {
+        TOMOCAM_TRACE_SCOPE("tiff::ifd_offsets", "io");
+        TIFF *tif = TIFFOpen(filename.c_str(), "r");
+        if (!tif) throw std::runtime_error("failed to open " + filename);
+        detail::tiff_ptr guard(tif, &TIFFClose);
+
+        std::vector<uint64_t> offsets;
+        do {
+            offsets.push_back(TIFFCurrentDirOffset(tif));
+        } while (TIFFReadDirectory(tif));
+        return offsets;
     }
+
+    /** read a block of a multi-page tiff, decoding only the strips that
+     * overlap the ROI rows
+     * @param filename input file
+     * @param roi {page, row, col} start and count, zero count for all
+     * @param ifds page directory offsets from ifd_offsets(), empty to walk
+     * the directory chain
+     * @tparam T sample type stored in the file
+     * @tparam Out sample type of the result; pages are converted as they
+     * are decoded, so no copy in the stored type is ever made
+     * @param progress called after every page with the fraction read,
+     * false stops the read and leaves the remaining pages unset
+     * @return data of shape roi.count
+     */
+    template <Sample T, Sample Out = T>
+    inline Array<Out> read(std::string filename, const Roi &roi,
+        const std::vector<uint64_t> &ifds = {},
+        const std::function<bool(double)> &progress = {}) {
+        TOMOCAM_TRACE_SCOPE("tiff::read", "io");
+
+        TIFF *tif = TIFFOpen(filename.c_str(), "r");
+        if (!tif) throw std::runtime_error("failed to open " + filename);
+        detail::tiff_ptr guard(tif, &TIFFClose);
+
+        // get image size
+        uint32_t w, h;
+        TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &w);
+        TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &h);
+        DType t = detail::page_dtype(tif);
+        if (t != dtype_v<T>) {
+            throw std::runtime_error(std::string("tiff holds ") + dtype_name(t) +
+                                     ", not " + dtype_traits<T>::name);
+        }
+        if (TIFFIsTiled(tif))
+            throw std::runtime_error("tiled tiff is not supported");
+
+        // counting pages walks every directory, the index already knows
+        uint32_t npages = ifds.empty() ? TIFFNumberOfDirectories(tif)
+                                       : static_cast<uint32_t>(ifds.size());
+        Roi r = roi.clip(dims_t{npages, h, w});
+        Array<Out> data(r.count);
+
+        // with an index every page is one seek, otherwise walk the IFD
+        // chain once instead of seeking to every page
+        if (ifds.empty() && !TIFFSetDirectory(tif, static_cast<tdir_t>(r.start.n0)))
+            throw std::runtime_error("failed to seek tiff page");
+        std::vector<T> strip;
+        for (uint32_t i = 0; i < r.count.n0; i++) {
+            bool ok = ifds.empty()
+                          ? (i == 0 || TIFFReadDirectory(tif))
+                          : TIFFSetSubDirectory(tif, ifds[r.start.n0 + i]);
+            if (!ok) throw std::runtime_error("failed to read tiff page");
+            detail::read_page(tif, r, data.begin() + data.flatIdx(i, 0, 0),
+                strip, w);
+            if (progress && !progress(double(i + 1) / r.count.n0)) break;
+        }
+        return data;
+    }
+
+    template <Sample T>
+    inline Array<T> read(std::string filename) {
+        return read<T>(filename, Roi{});
+    }
+
+    /** sample type of a tiff stack, from its first page, for visit()
+     * @throw std::runtime_error for a type dtype.h has no entry for
+     */
+    inline DType dtype(const std::string &filename) {
+        TIFF *tif = TIFFOpen(filename.c_str(), "r");
+        if (!tif) throw std::runtime_error("failed to open " + filename);
+        detail::tiff_ptr guard(tif, &TIFFClose);
+        return detail::page_dtype(tif);
+    }
+
 } // namespace tomocam::tiff
 #endif // TIFFIO__H
@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef TOMOCAM_TRACE__H
+#define TOMOCAM_TRACE__H
+
+namespace tomocam::trace {
+
+    using clock = std::chrono::steady_clock;
+
+    // one complete ("ph":"X") event in the Chrome trace format
+    struct Event {
+        const char *name;
+        const char *cat;
+        uint64_t ts;  // microseconds since tracer start
+        uint64_t dur; // microseconds
+        uint32_t tid;
+    };
+
+    // events kept per thread by default, 2 MB of Event each
+    constexpr size_t TRACE_EVENTS_PER_THREAD = 1 << 16;
+
+    /** process-wide trace recorder
+     * Events are appended to per-thread buffers. Each buffer has its own
+     * lock, which only dump() and clear() contend for, so recording
+     * threads never wait on each other. A full buffer is a ring: the
+     * oldest event is overwritten and counted as dropped. When recording
+     * is off a scope costs one relaxed atomic load.
+     */
+    class Tracer {
+      private:
+        struct Buffer {
+            uint32_t tid;
+            std::mutex mtx;
+            std::vector<Event> events;
+            size_t next = 0; // oldest event once the buffer is full
+            uint64_t dropped = 0;
+        };
+
+        std::atomic<bool> enabled_;
+        std::atomic<size_t> capacity_;
+        clock::time_point t0_;
+        std::mutex mtx_;
+        std::vector<std::shared_ptr<Buffer>> buffers_;
+
+        Tracer() : enabled_(false), capacity_(TRACE_EVENTS_PER_THREAD), t0_(clock::now()) {}
+
+        Buffer &local() {
+            thread_local std::shared_ptr<Buffer> buf;
+            if (!buf) {
+                buf = std::make_shared<Buffer>();
+                buf->events.reserve(std::min<size_t>(4096, capacity_));
+                std::lock_guard<std::mutex> lock(mtx_);
+                buf->tid = static_cast<uint32_t>(buffers_.size());
+                buffers_.push_back(buf);
+            }
+            return *buf;
+        }
+
+      public:
+        static Tracer &instance() {
+            static Tracer tracer;
+            return tracer;
+        }
+
+        bool enabled() const {
+            return enabled_.load(std::memory_order_relaxed);
+        }
+        void enable(bool on) { enabled_.store(on, std::memory_order_relaxed); }
+
+        // events kept per thread; applies to buffers after the next clear()
+        void set_capacity(size_t n) { capacity_ = std::max<size_t>(n, 1); }
+
+        uint64_t now() const {
+            return std::chrono::duration_cast<std::chrono::microseconds>(
+                clock::now() - t0_)
+                .count();
+        }
+
+        void record(const char *name, const char *cat, uint64_t ts,
+            uint64_t dur) {
+            auto &buf = local();
+            std::lock_guard<std::mutex> lock(buf.mtx);
+            if (buf.dropped == 0 && buf.events.size() < capacity_.load(std::memory_order_relaxed)) {
+                buf.events.push_back({name, cat, ts, dur, buf.tid});
+                return;
+            }
+            buf.events[buf.next] = {name, cat, ts, dur, buf.tid};
+            buf.next = (buf.next + 1) % buf.events.size();
+            buf.dropped++;
+        }
+
+        // drop everything recorded so far
+        void clear() {
+            std::lock_guard<std::mutex> lock(mtx_);
+            for (auto &b : buffers_) {
+                std::lock_guard<std::mutex> block(b->mtx);
+                b->events.clear();
+                b->next = 0;
+                b->dropped = 0;
+            }
+        }
+
+        // events overwritten in full buffers since the last clear()
+        uint64_t dropped() {
+            std::lock_guard<std::mutex> lock(mtx_);
+            uint64_t n = 0;
+            for (auto &b : buffers_) {
+                std::lock_guard<std::mutex> block(b->mtx);
+                n += b->dropped;
+            }
+            return n;
+        }
+
+        /** write all recorded events as Chrome-trace / Perfetto JSON
+         * Safe while other threads record; events recorded during the
+         * call may be left out. The number of dropped events is stored
+         * as otherData.dropped_events.
+         * @param filename output file
+         * @return false if the file could not be written
+         */
+        bool dump(const std::string &filename) {
+            // snapshot under the locks, write without holding them
+            std::vector<Event> events;
+            uint64_t dropped = 0;
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                for (auto &b : buffers_) {
+                    std::lock_guard<std::mutex> block(b->mtx);
+                    // oldest first
+                    auto mid = b->events.begin() + b->next;
+                    events.insert(events.end(), mid, b->events.end());
+                    events.insert(events.end(), b->events.begin(), mid);
+                    dropped += b->dropped;
+                }
+            }
+
+            std::ofstream out(filename);
+            if (!out) return false;
+            out << "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":" << dropped
+                << "},\"traceEvents\":[";
+            bool first = true;
+            for (auto &e : events) {
+                if (!first) out << ",";
+                first = false;
+                out << "\n{\"name\":\"" << e.name << "\",\"cat\":\""
+                    << e.cat << "\",\"ph\":\"X\",\"ts\":" << e.ts
+                    << ",\"dur\":" << e.dur << ",\"pid\":1,\"tid\":"
+                    << e.tid << "}";
+            }
+            out << "\n]}\n";
+            return static_cast<bool>(out);
+        }
+    };
+
+    // RAII timer, records one event on destruction if tracing was on
+    class Scope {
+      private:
+        const char *name_;
+        const char *cat_;
+        uint64_t start_;
+        bool active_;
+
+      public:
+        Scope(const char *name, const char *cat) :
+            name_(name), cat_(cat), start_(0),
+            active_(Tracer::instance().enabled()) {
+            if (active_) start_ = Tracer::instance().now();
+        }
+        ~Scope() {
+            if (active_) {
+                auto &t = Tracer::instance();
+                t.record(name_, cat_, start_, t.now() - start_);
+            }
+        }
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+    };
+
+    /** running counters behind the performance HUD
+     * Updated by the viewer, loader and exporter, read by the GUI timer.
+     */
+    struct Metrics {
+        std::atomic<uint64_t> frames{0};
+        std::atomic<uint64_t> frame_us{0};      // last frame
+        std::atomic<uint64_t> load_bytes{0};    // last load
+        std::atomic<uint64_t> load_us{0};
+        std::atomic<uint64_t> export_patches{0}; // last export
+        std::atomic<uint64_t> export_us{0};
+
+        static Metrics &instance() {
+            static Metrics m;
+            return m;
+        }
+    };
+
+    inline uint64_t elapsed_us(clock::time_point t0) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            clock::now() - t0)
+            .count();
+    }
+} // namespace tomocam::trace
+
+#define TOMOCAM_TRACE_CAT_(a, b) a##b
+#define TOMOCAM_TRACE_CAT(a, b) TOMOCAM_TRACE_CAT_(a, b)
+
+#ifdef TOMOCAM_NO_TRACE
+#define TOMOCAM_TRACE_SCOPE(name, cat)
+#else
+#define TOMOCAM_TRACE_SCOPE(name, cat)                                         \
+    tomocam::trace::Scope TOMOCAM_TRACE_CAT(trace_scope_, __LINE__)(name, cat)
+#endif
+
+#endif // TOMOCAM_TRACE__H
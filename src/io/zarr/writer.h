@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#include <zlib.h>
+
+#include "../dtype.h"
+#include "../trace.h"
+
+#ifndef TOMOCAM_ZARR_WRITER__H
+#define TOMOCAM_ZARR_WRITER__H
+
+namespace tomocam::zarr {
+
+    /* Zarr v2 directory store for datasets of equally shaped items, the
+     * counterpart of h5::Appender without the HDF5 library lock:
+     *
+     *   <root>/.zgroup            {"zarr_format": 2}
+     *   <root>/<name>/.zarray     shape (N, item...), one chunk per item
+     *   <root>/<name>/<i>.0.0     item i, zlib compressed or raw
+     *
+     * Every item is its own chunk file, so threads write items
+     * concurrently with no shared state but an atomic extent. .zarray is
+     * written once, by close(), when the number of items is known; a
+     * store that was never closed has no metadata and is not read.
+     */
+
+    template <Sample T>
+    constexpr const char *dtype() {
+        return dtype_traits<T>::numpy;
+    }
+
+    namespace detail {
+        inline void write_file(const std::filesystem::path &path, const void *data, size_t n) {
+            std::FILE *fp = std::fopen(path.c_str(), "wb");
+            if (!fp) throw std::runtime_error("failed to create " + path.string());
+            size_t done = std::fwrite(data, 1, n, fp);
+            if (std::fclose(fp) != 0 || done != n)
+                throw std::runtime_error("failed to write " + path.string());
+        }
+
+        inline void write_text(const std::filesystem::path &path, const std::string &s) {
+            write_file(path, s.data(), s.size());
+        }
+
+        inline std::string json_list(const std::vector<uint64_t> &v) {
+            std::string s = "[";
+            for (size_t i = 0; i < v.size(); i++) s += (i ? ", " : "") + std::to_string(v[i]);
+            return s + "]";
+        }
+    } // namespace detail
+
+    template <typename T>
+    class Dataset {
+      private:
+        std::filesystem::path dir_;
+        std::vector<uint64_t> item_;
+        size_t item_bytes_;
+        int level_;
+        std::atomic<uint64_t> extent_;
+        std::atomic<uint64_t> written_; // one past the highest chunk file
+        bool open_;
+
+        std::filesystem::path chunk(uint64_t i) const {
+            std::string key = std::to_string(i);
+            for (size_t d = 0; d < item_.size(); d++) key += ".0";
+            return dir_ / key;
+        }
+
+        static void raise(std::atomic<uint64_t> &v, uint64_t end) {
+            uint64_t cur = v.load(std::memory_order_relaxed);
+            while (cur < end && !v.compare_exchange_weak(cur, end, std::memory_order_relaxed)) {}
+        }
+
+      public:
+        /**
+         * @param dir dataset directory, replaced if it exists
+         * @param item shape of one item
+         * @param level zlib level, 0 stores chunks uncompressed
+         */
+        Dataset(std::filesystem::path dir, std::vector<uint64_t> item, int level = 1) :
+            dir_(std::move(dir)), item_(std::move(item)), item_bytes_(sizeof(T)),
+            level_(level), extent_(0), written_(0), open_(true) {
+            for (auto n : item_) item_bytes_ *= n;
+            std::filesystem::remove_all(dir_);
+            std::filesystem::create_directories(dir_);
+        }
+
+        ~Dataset() {
+            try {
+                close();
+            } catch (const std::exception &) {
+                // metadata is missing, readers see no dataset
+            }
+        }
+
+        Dataset(const Dataset &) = delete;
+        Dataset &operator=(const Dataset &) = delete;
+        Dataset(Dataset &&rhs) noexcept :
+            dir_(std::move(rhs.dir_)), item_(std::move(rhs.item_)),
+            item_bytes_(rhs.item_bytes_), level_(rhs.level_),
+            extent_(rhs.extent_.load()), written_(rhs.written_.load()), open_(rhs.open_) {
+            rhs.open_ = false;
+        }
+
+        // one past the highest item written
+        uint64_t size() const { return extent_; }
+
+        /** store item i; safe to call from many threads for distinct i
+         * @param data item_bytes of contiguous item data
+         */
+        void write(uint64_t i, const T *data) {
+            TOMOCAM_TRACE_SCOPE("zarr::write_chunk", "io");
+            if (level_ > 0) {
+                uLongf n = compressBound(item_bytes_);
+                std::vector<Bytef> buf(n);
+                if (compress2(buf.data(), &n, reinterpret_cast<const Bytef *>(data),
+                        item_bytes_, level_) != Z_OK)
+                    throw std::runtime_error("zlib compression failed");
+                detail::write_file(chunk(i), buf.data(), n);
+            } else {
+                detail::write_file(chunk(i), data, item_bytes_);
+            }
+            raise(written_, i + 1);
+            raise(extent_, i + 1);
+        }
+
+        // drop items from n on, e.g. after a stop; their chunk files are
+        // deleted by close()
+        void truncate(uint64_t n) { extent_ = std::min<uint64_t>(extent_, n); }
+
+        // write .zarray and delete chunks past the extent; the dataset
+        // covers every item written and not truncated
+        void close() {
+            if (!open_) return;
+            open_ = false;
+            for (uint64_t i = extent_; i < written_; i++) {
+                std::error_code ec;
+                std::filesystem::remove(chunk(i), ec);
+            }
+            std::vector<uint64_t> shape{extent_.load()};
+            std::vector<uint64_t> chunks{1};
+            shape.insert(shape.end(), item_.begin(), item_.end());
+            chunks.insert(chunks.end(), item_.begin(), item_.end());
+            std::string compressor = level_ > 0
+                ? "{\"id\": \"zlib\", \"level\": " + std::to_string(level_) + "}"
+                : "null";
+            detail::write_text(dir_ / ".zarray",
+                "{\n"
+                "    \"zarr_format\": 2,\n"
+                "    \"shape\": " + detail::json_list(shape) + ",\n"
+                "    \"chunks\": " + detail::json_list(chunks) + ",\n"
+                "    \"dtype\": \"" + dtype<T>() + "\",\n"
+                "    \"compressor\": " + compressor + ",\n"
+                "    \"fill_value\": 0,\n"
+                "    \"order\": \"C\",\n"
+                "    \"filters\": null,\n"
+                "    \"dimension_separator\": \".\"\n"
+                "}\n");
+        }
+    };
+
+    class Writer {
+      private:
+        std::filesystem::path root_;
+        int level_;
+
+      public:
+        /**
+         * @param root store directory, e.g. volumes.zarr
+         * @param level zlib level of every dataset, 0 for raw chunks
+         */
+        Writer(std::filesystem::path root, int level = 1) : root_(std::move(root)), level_(level) {
+            std::filesystem::create_directories(root_);
+            detail::write_text(root_ / ".zgroup", "{\n    \"zarr_format\": 2\n}\n");
+        }
+
+        template <typename T>
+        Dataset<T> dataset(const char *name, std::vector<uint64_t> item) {
+            return Dataset<T>(root_ / name, std::move(item), level_);
+        }
+    };
+} // namespace tomocam::zarr
+#endif // TOMOCAM_ZARR_WRITER__H
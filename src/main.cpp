@@ -1,16 +1,34 @@
 #include <QApplication>
+#include <cstdio>
+#include <cstdlib>
 
 #include "image_viewer.h"
 #include "io/array.h"
+#include "io/trace.h"
 #include "main_window.h"
 
 int main(int argc, char *argv[]) {
     QApplication app(argc, argv);
 
+    // TOMOVIEW_TRACE=<file.json> records a trace for the whole session
+    const char *trace_file = std::getenv("TOMOVIEW_TRACE");
+    if (trace_file) {
+        tomocam::trace::Tracer::instance().enable(true);
+    }
+
     // Example: Create a 3D float array: depth x height x width
     MainWindow win;
     win.resize(512, 512);
     win.show();
 
-    return app.exec();
+    int rc = app.exec();
+    if (trace_file) {
+        auto &tracer = tomocam::trace::Tracer::instance();
+        if (!tracer.dump(trace_file))
+            std::fprintf(stderr, "failed to write %s\n", trace_file);
+        else if (uint64_t dropped = tracer.dropped())
+            std::fprintf(stderr, "%s: %llu oldest events dropped\n", trace_file,
+                         static_cast<unsigned long long>(dropped));
+    }
+    return rc;
 }
@@ -1,5 +1,10 @@
+#include <QActionGroup>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QVBoxLayout>
 #include <QFileDialog>
 #include <QGuiApplication>
+#include <QInputDialog>
 #include <QMenuBar>
 #include <QMessageBox>
 #include <QPushButton>
@@ -7,18 +12,25 @@
 #include <QStatusBar>
 #include <QToolBar>
 #include <filesystem>
+#include <memory>
+#include <random>
 #include <qaction.h>
 #include <qdialog.h>
 #include <qmenu.h>
 #include <qpushbutton.h>
 
+#include "dataset_dialog.h"
 #include "io/array.h"
+#include "io/hdf5/reader.h"
 #include "io/loader.h"
+#include "io/preview.h"
+#include "io/trace.h"
 #include "main_window.h"
 
-MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
+MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), loadGeneration(0) {
 
     tomocam::Array<float> img0(1, 1, 1);
+    img0.fill(0.f);
     viewer = new ImageViewer(img0, this); // Start with empty stack
     setCentralWidget(viewer);
 
@@ -39,6 +51,128 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
     connect(exportAction, &QAction::triggered, this, &MainWindow::export_patches);
     exportAction->setEnabled(false);
 
+    export3dAction = fileMenu->addAction("Export &3D Patches...");
+    connect(export3dAction, &QAction::triggered, this, &MainWindow::export_volumes);
+    export3dAction->setEnabled(false);
+
+    // exports that run in the background while other scans are opened
+    queueAction = fileMenu->addAction("&Queue Export");
+    connect(queueAction, &QAction::triggered, this, &MainWindow::queueExport);
+    queueAction->setEnabled(false);
+    QAction *queueScansAction = fileMenu->addAction("Queue Sca&ns...");
+    connect(queueScansAction, &QAction::triggered, this, &MainWindow::queueScans);
+
+    // reload only the bounding box of the picked field of view
+    cropAction = fileMenu->addAction("Crop to &ROI...");
+    connect(cropAction, &QAction::triggered, this, &MainWindow::cropToRoi);
+    cropAction->setEnabled(false);
+
+    // compression used for exported tiff patches
+    QMenu *compMenu = fileMenu->addMenu("Export &Compression");
+    QActionGroup *compGroup = new QActionGroup(this);
+    const std::pair<const char *, tomocam::tiff::Compression> codecs[] = {
+        {"None", tomocam::tiff::Compression::None},
+        {"LZW", tomocam::tiff::Compression::LZW},
+        {"Deflate", tomocam::tiff::Compression::Deflate},
+        {"Zstd", tomocam::tiff::Compression::Zstd},
+    };
+    for (auto [name, codec] : codecs) {
+        QAction *act = compMenu->addAction(name);
+        act->setCheckable(true);
+        act->setChecked(codec == tomocam::tiff::Compression::None);
+        compGroup->addAction(act);
+        connect(act, &QAction::triggered, this, [this, codec]() {
+            tomocam::tiff::WriteOptions opts;
+            opts.compression = codec;
+            viewer->setTiffOptions(opts);
+        });
+    }
+
+    // reject mostly-empty patches before they are written
+    QAction *qualityAction = fileMenu->addAction("Filter Patch &Quality");
+    qualityAction->setCheckable(true);
+    connect(qualityAction, &QAction::toggled, this, [this](bool on) {
+        auto f = viewer->getQualityFilter();
+        f.enabled = on;
+        viewer->setQualityFilter(f);
+    });
+    QAction *qualitySettings = fileMenu->addAction("Quality &Settings...");
+    connect(qualitySettings, &QAction::triggered, this, [this]() {
+        auto f = viewer->getQualityFilter();
+        bool ok = false;
+        double frac = QInputDialog::getDouble(this, "Patch Quality", "Minimum foreground fraction",
+                                              f.min_fg_fraction, 0.0, 1.0, 2, &ok);
+        if (!ok)
+            return;
+        f.min_fg_fraction = frac;
+        double sd = QInputDialog::getDouble(this, "Patch Quality", "Minimum standard deviation",
+                                            f.min_std, 0.0, 1.0e9, 4, &ok);
+        if (ok)
+            f.min_std = sd;
+        viewer->setQualityFilter(f);
+    });
+
+    fileMenu->addSeparator();
+    QAction *saveTraceAction = fileMenu->addAction("Save &Trace...");
+    connect(saveTraceAction, &QAction::triggered, this, &MainWindow::saveTrace);
+
+    // performance overlay + trace recording
+    QMenu *viewMenu = menuBar()->addMenu("&View");
+    hudAction = viewMenu->addAction("Performance &HUD");
+    hudAction->setCheckable(true);
+    traceAction = viewMenu->addAction("&Record Trace");
+    traceAction->setCheckable(true);
+    traceAction->setChecked(tomocam::trace::Tracer::instance().enabled());
+    connect(traceAction, &QAction::toggled,
+            [](bool on) { tomocam::trace::Tracer::instance().enable(on); });
+
+    // export job list
+    exportQueue = std::make_unique<tomocam::ExportQueue>();
+    jobsDock = new QDockWidget("Export Jobs", this);
+    QWidget *jobsPanel = new QWidget(jobsDock);
+    jobsTable = new QTableWidget(0, 4, jobsPanel);
+    jobsTable->setHorizontalHeaderLabels({"Scan", "State", "Progress", "Patches"});
+    jobsTable->horizontalHeader()->setSectionResizeMode(0, QHeaderView::Stretch);
+    jobsTable->setSelectionBehavior(QAbstractItemView::SelectRows);
+    jobsTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    QPushButton *cancelButton = new QPushButton("Cancel", jobsPanel);
+    connect(cancelButton, &QPushButton::clicked, this, &MainWindow::cancelJobs);
+    QPushButton *clearButton = new QPushButton("Clear Finished", jobsPanel);
+    connect(clearButton, &QPushButton::clicked, this, [this]() {
+        exportQueue->clear_finished();
+        refreshJobs();
+    });
+    QHBoxLayout *buttons = new QHBoxLayout;
+    buttons->addWidget(cancelButton);
+    buttons->addWidget(clearButton);
+    buttons->addStretch();
+    QVBoxLayout *jobsLayout = new QVBoxLayout(jobsPanel);
+    jobsLayout->addWidget(jobsTable);
+    jobsLayout->addLayout(buttons);
+    jobsDock->setWidget(jobsPanel);
+    addDockWidget(Qt::BottomDockWidgetArea, jobsDock);
+    jobsDock->hide();
+    viewMenu->addAction(jobsDock->toggleViewAction());
+    jobsTimer = new QTimer(this);
+    jobsTimer->setInterval(250);
+    connect(jobsTimer, &QTimer::timeout, this, &MainWindow::refreshJobs);
+
+    hudLabel = new QLabel(this);
+    hudLabel->setVisible(false);
+    statusBar()->addPermanentWidget(hudLabel);
+    hudTimer = new QTimer(this);
+    hudTimer->setInterval(500);
+    connect(hudTimer, &QTimer::timeout, this, &MainWindow::updateHud);
+    connect(hudAction, &QAction::toggled, this, [this](bool on) {
+        hudLabel->setVisible(on);
+        if (on) {
+            updateHud();
+            hudTimer->start();
+        } else {
+            hudTimer->stop();
+        }
+    });
+
     // Toolbar
     QToolBar *toolbar = addToolBar("&Tools");
     pick1Action = toolbar->addAction("&Set Center");
@@ -54,12 +188,18 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
         viewer->setPickMode(PickMode::PickP2);
         statusBar()->showMessage("Pick approximate radius");
     });
+    detectAction = toolbar->addAction("&Detect");
+    detectAction->setEnabled(false);
+    connect(detectAction, &QAction::triggered, this, &MainWindow::detectFov);
     resetAction = toolbar->addAction("&Reset");
     resetAction->setEnabled(false);
     connect(resetAction, &QAction::triggered, this, [this]() {
         pick1Action->setEnabled(true);
         pick2Action->setEnabled(true);
         exportAction->setEnabled(false);
+        export3dAction->setEnabled(false);
+        cropAction->setEnabled(false);
+        queueAction->setEnabled(false);
         viewer->reset();
         statusBar()->showMessage("Ready");
     });
@@ -68,6 +208,13 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
     statusBar()->showMessage("Ready");
     connect(viewer, &ImageViewer::pickUpdated, this, &MainWindow::onPickUpdated);
     connect(viewer, &ImageViewer::picksCompleted, this, &MainWindow::onPicksCompleted);
+    connect(viewer, &ImageViewer::fovDetected, this, &MainWindow::onFovDetected);
+}
+
+MainWindow::~MainWindow() {
+    // a full-resolution read still running stops at its next slab, so
+    // loadPool joins promptly when it is destroyed
+    closing = true;
 }
 
 void MainWindow::openFile() {
@@ -77,21 +224,159 @@ void MainWindow::openFile() {
         return;
 
     auto filename = fileName.toStdString();
-    auto data = tomocam::loader(fileName.toStdString());
-    auto width = data.ncols();
-    auto height = data.nrows();
-    auto depth = data.nslices();
 
-    if (width < 0 || height < 0 || depth < 0) {
-        QMessageBox::critical(this, "Error", "Failed to open file");
+    // HDF5: pick a dataset and slices from metadata before any data is read
+    std::string dataset;
+    tomocam::Roi roi;
+    tomocam::dims_t full{0, 0, 0};
+    bool whole = true; // all of the default dataset, what the preview sidecar holds
+    if (std::filesystem::path(filename).extension() == ".h5") {
+        std::vector<tomocam::h5::DatasetInfo> sets;
+        std::string preferred;
+        try {
+            tomocam::h5::Reader reader(filename.c_str());
+            if (!reader.valid())
+                throw std::runtime_error("not an HDF5 file");
+            preferred = tomocam::default_dataset(reader);
+            sets = reader.list();
+        } catch (const std::exception &e) {
+            QMessageBox::critical(this, "Error", QString("Failed to open file: ") + e.what());
+            return;
+        }
+        DatasetDialog dialog(std::move(sets), preferred, this);
+        if (dialog.exec() != QDialog::Accepted)
+            return;
+        dataset = dialog.dataset();
+        full = dialog.dims();
+        whole = dataset == preferred && dialog.fullRange();
+        if (!dialog.fullRange())
+            roi = dialog.roi();
+    }
+    uint64_t gen = ++loadGeneration;
+
+    // reopen: show the cached preview now and read full resolution behind it
+    auto side = whole ? tomocam::preview::load(filename, std::max(maxW, maxH)) : std::nullopt;
+    if (side) {
+        for (QAction *act :
+             {pick1Action, pick2Action, detectAction, resetAction, exportAction, export3dAction,
+              cropAction, queueAction})
+            act->setEnabled(false);
+        viewer->showPreview(std::move(side->levels.front()), side->dims);
+        statusBar()->showMessage("Preview, loading full resolution...");
+
+        auto stats = std::make_shared<std::vector<tomocam::preview::SliceStats>>(
+            std::move(side->stats));
+        loadPool.submit([this, gen, filename, dataset, ifds = side->ifds, stats]() {
+            auto t0 = tomocam::trace::clock::now();
+            std::shared_ptr<tomocam::Array<float>> data;
+            QString error;
+            try {
+                // give up once a newer load starts or the window closes
+                auto current = [this, gen](double) {
+                    return !closing && gen == loadGeneration;
+                };
+                data = std::make_shared<tomocam::Array<float>>(
+                    tomocam::loader(filename, tomocam::Roi{}, ifds, dataset, current));
+            } catch (const std::exception &e) {
+                error = e.what();
+            }
+            uint64_t us = tomocam::trace::elapsed_us(t0);
+
+            QMetaObject::invokeMethod(
+                this,
+                [this, gen, filename, dataset, ifds, stats, data, error, us]() {
+                    if (gen != loadGeneration)
+                        return;
+                    if (!data) {
+                        QMessageBox::critical(this, "Error", "Failed to open file: " + error);
+                        return;
+                    }
+                    auto &metrics = tomocam::trace::Metrics::instance();
+                    metrics.load_us = us;
+                    metrics.load_bytes = static_cast<uint64_t>(data->size()) * sizeof(float);
+                    auto dims = data->dims();
+                    viewer->updateImageStack(std::move(*data), true);
+                    viewer->setSliceStats(std::move(*stats));
+                    ifdIndex = ifds;
+                    loaded(filename, dataset, dims);
+                },
+                Qt::QueuedConnection);
+        });
         return;
     }
-    viewer->updateImageStack(data);
+
+    // first open: read in full, then write the sidecar in the background
+    tomocam::preview::Sidecar probe;
+    tomocam::Array<float> data;
+    auto t0 = tomocam::trace::clock::now();
+    try {
+        probe = tomocam::preview::probe(filename);
+        data = tomocam::loader(filename, roi, probe.ifds, dataset);
+    } catch (const std::exception &e) {
+        QMessageBox::critical(this, "Error", QString("Failed to open file: ") + e.what());
+        return;
+    }
+    auto &metrics = tomocam::trace::Metrics::instance();
+    metrics.load_us = tomocam::trace::elapsed_us(t0);
+    metrics.load_bytes = static_cast<uint64_t>(data.size()) * sizeof(float);
+
+    // the sidecar is built here, before the volume moves into the viewer, so
+    // only one copy of it is ever resident; just the write goes to the pool
+    if (whole)
+        tomocam::preview::build(probe, data);
+    ifdIndex = probe.ifds;
+    if (dataset.empty())
+        full = data.dims();
+    viewer->updateImageStack(std::move(data));
+    loaded(filename, dataset, full, roi);
+    if (!whole)
+        return;
+
+    loadPool.submit([filename, probe = std::move(probe)]() {
+        try {
+            tomocam::preview::save(filename, probe);
+        } catch (const std::exception &) {
+            // e.g. read-only directory; reopening just takes the slow path
+        }
+    });
+}
+
+// full resolution data of filename is in the viewer
+void MainWindow::loaded(const std::string &filename, const std::string &dataset,
+                        tomocam::dims_t dims, const tomocam::Roi &roi) {
+    currentFile = filename;
+    currentDataset = dataset;
+    fullDims = dims;
+    currentRoi = roi.clip(fullDims);
+    cropAction->setEnabled(false);
     // turn on all the buttons
     pick1Action->setEnabled(true);
     pick2Action->setEnabled(true);
+    detectAction->setEnabled(true);
     resetAction->setEnabled(true);
     subdir_name = std::filesystem::path(filename).stem();
+    detectFov();
+}
+
+void MainWindow::detectFov() {
+    statusBar()->showMessage("Detecting field of view...");
+    viewer->detectFov();
+}
+
+void MainWindow::onFovDetected(const tomocam::Detection &d) {
+    if (!d.ok) {
+        statusBar()->showMessage(QString("Field of view not found (%1% of %2 edge points fit), "
+                                         "pick it by hand")
+                                     .arg(100.0 * d.inliers, 0, 'f', 0)
+                                     .arg(d.edge_points));
+        return;
+    }
+    pick1Action->setEnabled(false);
+    pick2Action->setEnabled(false);
+    statusBar()->showMessage(QString("Field of view: centre (%1, %2), radius %3")
+                                 .arg(d.fov.cx, 0, 'f', 1)
+                                 .arg(d.fov.cy, 0, 'f', 1)
+                                 .arg(d.fov.r, 0, 'f', 1));
 }
 
 void MainWindow::onPickUpdated(int which, QPoint pt) {
@@ -111,11 +396,209 @@ void MainWindow::onPicksCompleted(QPoint p1, QPoint p2) {
                                  .arg(p2.x())
                                  .arg(p2.y()));
     exportAction->setEnabled(true);
+    export3dAction->setEnabled(true);
+    cropAction->setEnabled(true);
+    queueAction->setEnabled(true);
+}
+
+void MainWindow::cropToRoi() {
+    // picks are relative to the current region, move them to file coordinates
+    tomocam::Circle fov = viewer->fov();
+    fov.cx += currentRoi.start.n2;
+    fov.cy += currentRoi.start.n1;
+
+    bool ok = false;
+    int nz = static_cast<int>(fullDims.n0);
+    int z0 = QInputDialog::getInt(this, "Crop to ROI", "First slice", currentRoi.start.n0, 0,
+                                  nz - 1, 1, &ok);
+    if (!ok)
+        return;
+    int count = QInputDialog::getInt(this, "Crop to ROI", "Number of slices",
+                                     std::min<int>(currentRoi.count.n0, nz - z0), 1, nz - z0, 1,
+                                     &ok);
+    if (!ok)
+        return;
+
+    tomocam::Roi roi;
+    try {
+        roi = tomocam::roi_from_circle(fov, fullDims, z0, count);
+    } catch (const std::exception &e) {
+        QMessageBox::critical(this, "Error", e.what());
+        return;
+    }
+
+    auto t0 = tomocam::trace::clock::now();
+    tomocam::Array<float> data;
+    try {
+        data = tomocam::loader(currentFile, roi, ifdIndex, currentDataset);
+    } catch (const std::exception &e) {
+        QMessageBox::critical(this, "Error", QString("Failed to load the region: ") + e.what());
+        return;
+    }
+    auto &metrics = tomocam::trace::Metrics::instance();
+    metrics.load_us = tomocam::trace::elapsed_us(t0);
+    metrics.load_bytes = static_cast<uint64_t>(data.size()) * sizeof(float);
+
+    viewer->updateImageStack(std::move(data));
+    currentRoi = roi;
+    fov.cx -= roi.start.n2;
+    fov.cy -= roi.start.n1;
+    viewer->setFov(fov);
+    statusBar()->showMessage(QString("Loaded %1 x %2 x %3 at (%4, %5, %6)")
+                                 .arg(roi.count.n0)
+                                 .arg(roi.count.n1)
+                                 .arg(roi.count.n2)
+                                 .arg(roi.start.n0)
+                                 .arg(roi.start.n1)
+                                 .arg(roi.start.n2));
 }
 
 void MainWindow::export_patches() {
     if (!std::filesystem::is_directory(subdir_name)) {
         std::filesystem::create_directory(subdir_name);
     }
-    viewer->export_patches(subdir_name);
+    auto stats = viewer->export_patches(subdir_name);
+    statusBar()->showMessage(QString("Exported %1 patches, rejected %2 candidates, %3 not found")
+                                 .arg(stats.accepted)
+                                 .arg(stats.rejected)
+                                 .arg(stats.missing));
+}
+
+void MainWindow::export_volumes() {
+    bool ok = false;
+    int nslc = viewer->nslices();
+    int depth = QInputDialog::getInt(this, "3D Patches", "Patch depth (slices)", std::min(64, nslc),
+                                     1, nslc, 1, &ok);
+    if (!ok)
+        return;
+
+    if (!std::filesystem::is_directory(subdir_name)) {
+        std::filesystem::create_directory(subdir_name);
+    }
+    tomocam::VolumeExport opts;
+    opts.filename = tomocam::next_output(subdir_name, "volumes", ".h5").string();
+    opts.depth = static_cast<uint32_t>(depth);
+    auto stats = viewer->export_volumes(opts);
+    statusBar()->showMessage(QString("Exported %1 sub-volumes to %2")
+                                 .arg(stats.accepted)
+                                 .arg(QString::fromStdString(opts.filename)));
+}
+
+tomocam::ExportJob MainWindow::makeJob(const std::string &filename) {
+    tomocam::ExportJob job;
+    job.filename = filename;
+    job.outdir = std::filesystem::path(filename).stem();
+    job.tiff = viewer->getTiffOptions();
+    job.filter = viewer->getQualityFilter();
+    job.seed = std::random_device{}();
+    return job;
+}
+
+// queue the open scan with its current picks and region
+void MainWindow::queueExport() {
+    auto job = makeJob(currentFile);
+    job.dataset = currentDataset;
+    job.roi = currentRoi;
+    job.ifds = ifdIndex;
+    job.fov = viewer->fov();
+    exportQueue->submit(std::move(job));
+    jobsDock->show();
+    jobsTimer->start();
+    refreshJobs();
+    statusBar()->showMessage("Queued export of " + QString::fromStdString(currentFile));
+}
+
+// queue scans without opening them, their field of view is detected
+void MainWindow::queueScans() {
+    QStringList files = QFileDialog::getOpenFileNames(
+        this, "Queue Scans", "", "TIFF Files (*.tif *.tiff);; HD5 Files (*.h5)");
+    if (files.isEmpty())
+        return;
+    for (const QString &f : files) {
+        auto job = makeJob(f.toStdString());
+        job.detect = true;
+        exportQueue->submit(std::move(job));
+    }
+    jobsDock->show();
+    jobsTimer->start();
+    refreshJobs();
+    statusBar()->showMessage(QString("Queued %1 scans").arg(files.size()));
+}
+
+void MainWindow::refreshJobs() {
+    auto jobs = exportQueue->snapshot();
+    jobsTable->setRowCount(static_cast<int>(jobs.size()));
+    bool active = false;
+    for (int row = 0; row < static_cast<int>(jobs.size()); row++) {
+        const auto &j = jobs[row];
+        auto name = QString::fromStdString(std::filesystem::path(j.filename).filename().string());
+        QString state = tomocam::to_string(j.state);
+        if (j.state == tomocam::JobState::Failed)
+            state += ": " + QString::fromStdString(j.error);
+        QString cells[4] = {name, state, QString("%1%").arg(100.0 * j.progress, 0, 'f', 0),
+                            QString::number(j.stats.accepted)};
+        for (int col = 0; col < 4; col++) {
+            QTableWidgetItem *item = jobsTable->item(row, col);
+            if (!item) {
+                item = new QTableWidgetItem;
+                jobsTable->setItem(row, col, item);
+            }
+            item->setText(cells[col]);
+        }
+        jobsTable->item(row, 0)->setData(Qt::UserRole, QVariant::fromValue<qulonglong>(j.id));
+        active |= j.state != tomocam::JobState::Done && j.state != tomocam::JobState::Failed &&
+                  j.state != tomocam::JobState::Cancelled;
+    }
+    if (!active)
+        jobsTimer->stop();
+}
+
+void MainWindow::cancelJobs() {
+    for (QModelIndex index : jobsTable->selectionModel()->selectedRows()) {
+        QTableWidgetItem *item = jobsTable->item(index.row(), 0);
+        if (item)
+            exportQueue->cancel(item->data(Qt::UserRole).toULongLong());
+    }
+    refreshJobs();
+}
+
+void MainWindow::updateHud() {
+    auto &m = tomocam::trace::Metrics::instance();
+
+    auto rate = [](double amount, uint64_t us) { return us ? amount * 1.0e6 / us : 0.0; };
+    double frame_ms = m.frame_us / 1000.0;
+    double load_mbs = rate(m.load_bytes / 1.0e6, m.load_us);
+    double export_ps = rate(static_cast<double>(m.export_patches), m.export_us);
+    auto cache = viewer->cacheStats();
+    uint64_t lookups = cache.hits + cache.misses;
+    QString hit = lookups ? QString("%1%").arg(100.0 * cache.hits / lookups, 0, 'f', 1)
+                          : QString("--");
+
+    hudLabel->setText(
+        QString("frame %1 ms | cache %2, %3 MB, %4 evicted | load %5 MB/s | export %6 patches/s")
+            .arg(frame_ms, 0, 'f', 1)
+            .arg(hit)
+            .arg(cache.bytes / 1.0e6, 0, 'f', 0)
+            .arg(cache.evictions)
+            .arg(load_mbs, 0, 'f', 1)
+            .arg(export_ps, 0, 'f', 1));
+}
+
+void MainWindow::saveTrace() {
+    QString fileName =
+        QFileDialog::getSaveFileName(this, "Save Trace", "tomoview_trace.json", "Trace (*.json)");
+    if (fileName.isEmpty())
+        return;
+    auto &tracer = tomocam::trace::Tracer::instance();
+    if (!tracer.dump(fileName.toStdString())) {
+        QMessageBox::critical(this, "Error", "Failed to write trace");
+        return;
+    }
+    uint64_t dropped = tracer.dropped();
+    if (dropped > 0)
+        statusBar()->showMessage(QString("Trace written to %1, %2 oldest events dropped")
+                                     .arg(fileName)
+                                     .arg(dropped));
+    else
+        statusBar()->showMessage("Trace written to " + fileName);
 }
@@ -1,34 +1,80 @@
 
 #ifndef MAIN_WINDOW__H
 #define MAIN_WINDOW__H
+#include <QDockWidget>
+#include <QLabel>
 #include <QMainWindow>
+#include <QTableWidget>
+#include <QTimer>
+#include <atomic>
 #include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
 
+#include "export_queue.h"
 #include "image_viewer.h"
+#include "io/thread_pool.h"
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
 
   public:
     MainWindow(QWidget *parent = nullptr);
+    ~MainWindow() override;
     int maxWidth() const { return maxW; }
     int maxHeight() const { return maxH; }
 
   private slots:
     void openFile();
     void export_patches();
+    void export_volumes();
+    void cropToRoi();
+    void detectFov();
+    void queueExport();
+    void queueScans();
+    void refreshJobs();
+    void cancelJobs();
     void onPicksCompleted(QPoint, QPoint);
     void onPickUpdated(int, QPoint);
+    void onFovDetected(const tomocam::Detection &);
+    void updateHud();
+    void saveTrace();
 
   private:
+    void loaded(const std::string &filename, const std::string &dataset, tomocam::dims_t dims,
+                const tomocam::Roi &roi = tomocam::Roi{});
+    tomocam::ExportJob makeJob(const std::string &filename);
+
     std::filesystem::path subdir_name;
+    std::string currentFile;
+    std::string currentDataset;     // HDF5 dataset of currentFile, empty for tiff
+    tomocam::dims_t fullDims;
+    tomocam::Roi currentRoi; // region of currentFile held by the viewer
+    std::vector<uint64_t> ifdIndex; // tiff page offsets of currentFile
+    std::atomic<uint64_t> loadGeneration; // drops results of superseded loads
+    std::atomic<bool> closing{false};     // stops background reads on shutdown
     ImageViewer *viewer;
     QAction *exportAction;
+    QAction *export3dAction;
+    QAction *cropAction;
+    QAction *queueAction;
     QAction *pick1Action;
     QAction *pick2Action;
+    QAction *detectAction;
     QAction *resetAction;
+    QAction *hudAction;
+    QAction *traceAction;
+    QLabel *hudLabel;
+    QTimer *hudTimer;
+    QDockWidget *jobsDock;
+    QTableWidget *jobsTable;
+    QTimer *jobsTimer;
     int maxW;
     int maxH;
+    // background reads and sidecar writes, one at a time
+    tomocam::ThreadPool loadPool{1};
+    std::unique_ptr<tomocam::ExportQueue> exportQueue;
 };
 
 #endif // MAIN_WINDOW__H
@@ -0,0 +1,216 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+
+#include "distributed.h"
+#include "fov_detect.h"
+#include "io/array.h"
+#include "io/hdf5/reader.h"
+#include "io/hdf5/writer.h"
+#include "patch_sampler.h"
+#include "save_patch.h"
+
+#ifndef H5_HAVE_PARALLEL
+#error "tomoview_mpi needs an HDF5 build with MPI (parallel HDF5)"
+#endif
+
+// Multi-process patch extraction: every rank reads a contiguous share of
+// the slices of each scan through MPI-IO, the field of view is fitted to
+// the combined projection, ranks sample their own slices and all patches
+// go to one shared file with collective writes.
+//
+//   mpirun -np 4 tomoview_mpi -o patches.h5 -n 8 scan1.h5 scan2.h5
+//
+// Output: /patches (N, [depth,] h, w) float, /origins (N, 4) int
+// {scan, first slice, y0, x0}. Patches of each scan are grouped by rank.
+
+namespace fs = std::filesystem;
+using namespace tomocam;
+
+static void usage(const char *prog) {
+    std::fprintf(stderr,
+                 "usage: mpirun -np N %s [options] scan.h5...\n"
+                 "  -o FILE    output file (default patches.h5)\n"
+                 "  -n N       patches per slice, or per slab with -d (default 1)\n"
+                 "  -d DEPTH   sample DEPTH-slice sub-volumes instead of 2D patches\n"
+                 "  -q         reject mostly empty patches\n"
+                 "  -s SEED    random seed (default: random, printed)\n"
+                 "  -m         fit the field of view on the mean projection\n",
+                 prog);
+}
+
+int main(int argc, char *argv[]) {
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    MPI_Comm comm = MPI_COMM_WORLD;
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    std::string outfile = "patches.h5";
+    int per_slice = 1;
+    uint32_t depth = 0;
+    QualityFilter filter;
+    DetectOptions detect;
+    uint32_t seed = std::random_device{}();
+    std::vector<std::string> scans;
+
+    bool bad_args = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "-o" && has_value) {
+            outfile = argv[++i];
+        } else if (arg == "-n" && has_value) {
+            per_slice = std::atoi(argv[++i]);
+        } else if (arg == "-d" && has_value) {
+            depth = static_cast<uint32_t>(std::atoi(argv[++i]));
+        } else if (arg == "-s" && has_value) {
+            seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "-q") {
+            filter.enabled = true;
+        } else if (arg == "-m") {
+            detect.use_max = false;
+        } else if (!arg.empty() && arg[0] == '-') {
+            bad_args = true;
+        } else {
+            scans.push_back(arg);
+        }
+    }
+    if (bad_args || scans.empty() || per_slice < 1) {
+        if (rank == 0) usage(argv[0]);
+        MPI_Finalize();
+        return 2;
+    }
+    // every rank must derive its stream from the same seed
+    MPI_Bcast(&seed, 1, MPI_UINT32_T, 0, comm);
+    if (rank == 0) std::printf("%d ranks, seed %u\n", size, seed);
+
+    int failed = 0;
+    auto start = std::chrono::steady_clock::now();
+    try {
+        h5::Writer out(outfile.c_str(), comm);
+        std::unique_ptr<h5::Appender<float>> patches;
+        std::unique_ptr<h5::Appender<int>> origins;
+        uint32_t unit = depth > 0 ? depth : 1;
+        uint32_t ny = 0, nx = 0;
+
+        for (uint32_t s = 0; s < scans.size(); s++) {
+            const auto &scan = scans[s];
+            auto report = [&](const char *what) {
+                if (rank == 0) std::fprintf(stderr, "%s: %s\n", scan.c_str(), what);
+                failed++;
+            };
+            if (fs::path(scan).extension() != ".h5" || !fs::exists(scan)) {
+                report("not an existing .h5 file");
+                continue;
+            }
+
+            // read this rank's slab; errors are agreed on before any collective
+            h5::Reader reader(scan.c_str(), comm);
+            dims_t full{0, 0, 0};
+            Array<float> slab;
+            dist::Range units{0, 0};
+            std::string error;
+            try {
+                if (!reader.valid() || !reader.exists("recon"))
+                    throw std::runtime_error("no recon dataset");
+                full = dims_t{uint32_t(reader.dims("recon", 0)), uint32_t(reader.dims("recon", 1)),
+                    uint32_t(reader.dims("recon", 2))};
+                units = dist::split(full.n0 / unit, rank, size);
+                if (units.size() > 0)
+                    slab = reader.read_roi<float>("recon",
+                        Roi{{units.begin * unit, 0, 0}, {units.size() * unit, full.n1, full.n2}});
+                else
+                    slab = Array<float>(0, full.n1, full.n2);
+            } catch (const std::exception &e) {
+                error = e.what();
+            }
+            if (!dist::all(error.empty(), comm)) {
+                report(error.empty() ? "read failed on another rank" : error.c_str());
+                continue;
+            }
+
+            uint32_t sny = std::min(PATCH_SIZE, full.n1);
+            uint32_t snx = std::min(PATCH_SIZE, full.n2);
+            if (!patches) {
+                ny = sny;
+                nx = snx;
+                std::vector<hsize_t> item{ny, nx};
+                if (depth > 0) item.insert(item.begin(), depth);
+                patches = std::make_unique<h5::Appender<float>>(out.appender<float>("patches", item));
+                origins = std::make_unique<h5::Appender<int>>(out.appender<int>("origins", {4}));
+            } else if (sny != ny || snx != nx) {
+                report("patch size differs from the first scan");
+                continue;
+            }
+
+            // same projection, hence the same circle, on every rank
+            auto proj = project(slab);
+            dist::allreduce(proj, slab.nslices(), comm);
+            auto d = fit_fov(detect.use_max ? proj.max_slice() : proj.mean_slice(), detect);
+            if (!d.ok) {
+                report("field of view not found");
+                continue;
+            }
+
+            auto gen = dist::rank_rng(seed, rank, s);
+            SampleStats stats;
+            auto locs = sample_volumes(slab, unit, d.fov, per_slice, filter, gen, stats);
+
+            size_t plane = size_t(ny) * nx;
+            size_t item = plane * unit;
+            std::vector<float> buf(locs.size() * item);
+            std::vector<int> org(locs.size() * 4);
+#pragma omp parallel for schedule(static)
+            for (int64_t p = 0; p < int64_t(locs.size()); p++) {
+                uint32_t y0 = patch_origin(locs[p].n1, full.n1);
+                uint32_t x0 = patch_origin(locs[p].n2, full.n2);
+                for (uint32_t z = 0; z < unit; z++) {
+                    float *dst = buf.data() + p * item + z * plane;
+                    for (uint32_t j = 0; j < ny; j++)
+                        std::memcpy(dst + size_t(j) * nx,
+                            slab.begin() + slab.flatIdx(locs[p].n0 + z, y0 + j, x0),
+                            nx * sizeof(float));
+                }
+                int *o = org.data() + p * 4;
+                o[0] = static_cast<int>(s);
+                o[1] = static_cast<int>(units.begin * unit + locs[p].n0);
+                o[2] = static_cast<int>(y0);
+                o[3] = static_cast<int>(x0);
+            }
+
+            auto [before, total] = dist::offsets(locs.size(), comm);
+            patches->append(buf.data(), locs.size(), before, total);
+            origins->append(org.data(), locs.size(), before, total);
+
+            stats = dist::allreduce(stats, comm);
+            if (rank == 0)
+                std::printf("%s: fov (%.1f, %.1f) r %.1f, %llu patches, %llu rejected, %llu missing\n",
+                            scan.c_str(), d.fov.cx, d.fov.cy, d.fov.r,
+                            static_cast<unsigned long long>(stats.accepted),
+                            static_cast<unsigned long long>(stats.rejected),
+                            static_cast<unsigned long long>(stats.missing));
+        }
+        if (rank == 0 && patches)
+            std::printf("%llu patches in %s, %.2f s\n",
+                        static_cast<unsigned long long>(patches->size()), outfile.c_str(),
+                        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    } catch (const std::exception &e) {
+        // a rank that fails inside a collective would leave the others waiting
+        std::fprintf(stderr, "rank %d: %s\n", rank, e.what());
+        MPI_Abort(comm, 1);
+    }
+
+    MPI_Finalize();
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "io/array.h"
+#include "io/integral.h"
+#include "io/reductions.h"
+#include "io/trace.h"
+#include "save_patch.h"
+
+#ifndef PATCH_SAMPLER__H
+#define PATCH_SAMPLER__H
+
+namespace tomocam {
+
+    // reconstruction field of view, in pixels of the full resolution slice
+    struct Circle {
+        float cx;
+        float cy;
+        float r;
+    };
+
+    /** bounding box of the field of view, padded by half a patch so that
+     * patches centred on the rim stay whole
+     * @param fov field of view circle
+     * @param full dimensions of the whole volume
+     * @param z0 first slice
+     * @param nz number of slices, 0 for all
+     */
+    inline Roi roi_from_circle(const Circle &fov, dims_t full, uint32_t z0 = 0,
+        uint32_t nz = 0) {
+        float pad = fov.r + PATCH_SIZE / 2;
+        auto lo = [](float v) { return static_cast<uint32_t>(std::max(0.f, v)); };
+        auto hi = [](float v, uint32_t n) {
+            return static_cast<uint32_t>(std::clamp(v, 1.f, float(n)));
+        };
+        uint32_t y0 = std::min(lo(fov.cy - pad), full.n1 - 1);
+        uint32_t x0 = std::min(lo(fov.cx - pad), full.n2 - 1);
+        uint32_t y1 = std::max(hi(std::ceil(fov.cy + pad), full.n1), y0 + 1);
+        uint32_t x1 = std::max(hi(std::ceil(fov.cx + pad), full.n2), x0 + 1);
+        return Roi{{z0, y0, x0}, {nz, y1 - y0, x1 - x0}}.clip(full);
+    }
+
+    struct SampleStats {
+        uint64_t accepted = 0;
+        uint64_t rejected = 0; // candidates that failed the quality filter
+        uint64_t missing = 0;  // patches given up after max_attempts
+    };
+
+    namespace detail {
+        inline uint32_t clamp_px(float v, uint32_t n) {
+            if (!(v > 0)) return 0;
+            return std::min(static_cast<uint32_t>(v), n - 1);
+        }
+    } // namespace detail
+
+    /** draw patch centres inside the field of view of one slice
+     * The slice is split into per_slice angular sectors with one patch per
+     * sector. With the quality filter on, a summed-area table of the slice
+     * gives every candidate's mean, variance and foreground fraction in
+     * O(1), and rejected candidates are redrawn from the same sector before
+     * any pixel is copied.
+     * @param img slice to sample
+     * @param index slice index recorded in the returned centres
+     * @param fov field of view circle
+     * @param per_slice patches per slice
+     * @param filter quality rules
+     * @param gen random generator
+     * @param stats accepted / rejected counts, accumulated
+     * @param locs {slice, y, x} patch centres are appended here
+     */
+    template <typename T>
+    void sample_slice(const Slice<T> &img, uint32_t index, const Circle &fov,
+        int per_slice, const QualityFilter &filter, std::mt19937 &gen,
+        SampleStats &stats, std::vector<dims_t> &locs) {
+
+        std::uniform_real_distribution<float> unif(0.f, 1.f);
+        float sector = 2 * M_PI / per_slice;
+        uint32_t ny = std::min(PATCH_SIZE, img.nrows);
+        uint32_t nx = std::min(PATCH_SIZE, img.ncols);
+
+        IntegralImage sat;
+        if (filter.enabled) {
+            TOMOCAM_TRACE_SCOPE("integral_image", "export");
+            double thresh = filter.fg_threshold;
+            if (std::isnan(thresh))
+                thresh = reduce::otsu_threshold(reduce::histogram(img, 256));
+            sat = IntegralImage(img, thresh);
+        }
+
+        for (int j = 0; j < per_slice; j++) {
+            int attempts = filter.enabled ? filter.max_attempts : 1;
+            bool found = false;
+            for (int a = 0; a < attempts && !found; a++) {
+                float t = (j + unif(gen)) * sector;
+                float r = unif(gen) * fov.r;
+                uint32_t x = detail::clamp_px(fov.cx + r * std::cos(t), img.ncols);
+                uint32_t y = detail::clamp_px(fov.cy + r * std::sin(t), img.nrows);
+                if (filter.enabled) {
+                    auto s = sat.stats(patch_origin(y, img.nrows),
+                        patch_origin(x, img.ncols), ny, nx);
+                    if (!filter.accept(s)) {
+                        stats.rejected++;
+                        continue;
+                    }
+                }
+                locs.push_back(dims_t{index, y, x});
+                stats.accepted++;
+                found = true;
+            }
+            if (!found) stats.missing++;
+        }
+    }
+
+    /** draw 2D patch centres on every slice, see sample_slice
+     * @return {slice, y, x} patch centres
+     */
+    template <typename T>
+    std::vector<dims_t> sample_patches(const Array<T> &vol, const Circle &fov,
+        int per_slice, const QualityFilter &filter, std::mt19937 &gen,
+        SampleStats &stats) {
+        TOMOCAM_TRACE_SCOPE("sample_patches", "export");
+        std::vector<dims_t> locs;
+        locs.reserve(size_t(vol.nslices()) * per_slice);
+        for (uint32_t i = 0; i < vol.nslices(); i++)
+            sample_slice(vol.slice(i), i, fov, per_slice, filter, gen, stats,
+                locs);
+        return locs;
+    }
+
+    /** draw 3D patch positions, per_slab of them for every slab of depth
+     * slices. Candidates are judged on the middle slice of the slab.
+     * @return {first slice, y centre, x centre} of each sub-volume
+     */
+    template <typename T>
+    std::vector<dims_t> sample_volumes(const Array<T> &vol, uint32_t depth,
+        const Circle &fov, int per_slab, const QualityFilter &filter,
+        std::mt19937 &gen, SampleStats &stats) {
+        TOMOCAM_TRACE_SCOPE("sample_volumes", "export");
+        std::vector<dims_t> locs;
+        for (uint32_t z0 = 0; z0 + depth <= vol.nslices(); z0 += depth)
+            sample_slice(vol.slice(z0 + depth / 2), z0, fov, per_slab, filter,
+                gen, stats, locs);
+        return locs;
+    }
+} // namespace tomocam
+#endif // PATCH_SAMPLER__H
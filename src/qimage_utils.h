@@ -0,0 +1,84 @@
+#include <QImage>
+#include <algorithm>
+#include <cstdint>
+
+#include "io/array.h"
+#include "io/reductions.h"
+
+#ifndef QIMAGE_UTILS__H
+#define QIMAGE_UTILS__H
+
+// (v - minVal) * scale clamped to [0, 255]; NaN maps to 0, the cast
+// of an out of range or NaN float is undefined
+inline uint8_t grayLevel(float v, float minVal, float scale) {
+    float g = (v - minVal) * scale;
+    g = g > 0.0f ? g : 0.0f;
+    g = g < 255.0f ? g : 255.0f;
+    return static_cast<uint8_t>(g);
+}
+
+/** map [minVal, maxVal] of a float slice to [0, 255] in an 8-bit image
+ * @param array slice to convert, values outside the range are clamped
+ * @param minVal value shown as black
+ * @param maxVal value shown as white
+ * @return grayscale image of the same size as the slice
+ */
+inline QImage grayscaleQImage(const tomocam::Slice<float> &array, float minVal,
+    float maxVal) {
+    int h = array.nrows;
+    int w = array.ncols;
+
+    QImage img(w, h, QImage::Format_Grayscale8);
+    float scale = (maxVal > minVal) ? 255.0f / (maxVal - minVal) : 0.0f;
+    // scanLine() may detach, so it is not called from the threads
+    uchar *bits = img.bits();
+    qsizetype bpl = img.bytesPerLine();
+#pragma omp parallel for schedule(static)
+    for (int y = 0; y < h; ++y) {
+        uchar *line = bits + y * bpl;
+        const float *row = array.ptr + static_cast<size_t>(y) * w;
+#pragma omp simd
+        for (int x = 0; x < w; ++x) {
+            line[x] = grayLevel(row[x], minVal, scale);
+        }
+    }
+    return img;
+}
+
+/** map [minVal, maxVal] of a float slice to [0, 255] into an 8-bit slice
+ * @param array slice to convert, values outside the range are clamped
+ * @param dst slice of the same shape
+ */
+inline void toGrayscale(const tomocam::Slice<float> &array, tomocam::Slice<uint8_t> dst,
+    float minVal, float maxVal) {
+    int64_t n = static_cast<int64_t>(array.size());
+    float scale = (maxVal > minVal) ? 255.0f / (maxVal - minVal) : 0.0f;
+#pragma omp parallel for simd schedule(static)
+    for (int64_t i = 0; i < n; ++i) {
+        dst.ptr[i] = grayLevel(array.ptr[i], minVal, scale);
+    }
+}
+
+/** normalize a float slice to [0, 255] and pack it into an 8-bit image
+ * @param array slice to convert
+ * @param minVal set to the slice minimum
+ * @param maxVal set to the slice maximum
+ * @return grayscale image of the same size as the slice
+ */
+inline QImage floatArrayToQImage(const tomocam::Slice<float> &array,
+    float &minVal, float &maxVal) {
+    // Find min/max for normalization
+    auto mm = tomocam::reduce::minmax(array);
+    minVal = mm.min;
+    maxVal = mm.max;
+    return grayscaleQImage(array, minVal, maxVal);
+}
+
+// wrap an 8-bit slice in a (deep copied) grayscale image
+inline QImage grayscaleQImage(const tomocam::Slice<uint8_t> &array) {
+    QImage img(array.ptr, array.ncols, array.nrows, array.ncols,
+        QImage::Format_Grayscale8);
+    return img.copy();
+}
+
+#endif // QIMAGE_UTILS__H
@@ -0,0 +1,105 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "io/shm_ring.h"
+
+// Stand-in for a training process: drains a patch ring filled by
+// tomoview_batch -S and reports what arrived, to test streaming locally.
+
+static void usage(const char *prog) {
+    std::fprintf(stderr,
+                 "usage: %s [options] NAME\n"
+                 "  -w SEC     wait this long for the ring to appear (default 30)\n"
+                 "  -v         print the metadata of every item\n",
+                 prog);
+}
+
+int main(int argc, char *argv[]) {
+    std::string name;
+    int wait_s = 30;
+    bool verbose = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-w" && i + 1 < argc) {
+            wait_s = std::atoi(argv[++i]);
+        } else if (arg == "-v") {
+            verbose = true;
+        } else if (arg == "-h" || arg == "--help") {
+            usage(argv[0]);
+            return 0;
+        } else if (!arg.empty() && arg[0] != '-' && name.empty()) {
+            name = arg[0] == '/' ? arg : "/" + arg;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (name.empty()) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    using clock = std::chrono::steady_clock;
+    auto deadline = clock::now() + std::chrono::seconds(wait_s);
+    std::unique_ptr<tomocam::shm::Ring> ring;
+    while (!ring) {
+        try {
+            ring = std::make_unique<tomocam::shm::Ring>(tomocam::shm::Ring::open(name));
+        } catch (const std::exception &e) {
+            if (clock::now() > deadline) {
+                std::fprintf(stderr, "%s\n", e.what());
+                return 1;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    }
+
+    const auto *h = ring->header();
+    bool is_float = std::strcmp(h->dtype, "<f4") == 0;
+    std::printf("%s: %u slots, item %s up to", name.c_str(), h->slots, h->dtype);
+    for (uint32_t d = 0; d < h->ndim; d++) std::printf("%s%u", d ? " x " : " ", h->shape[d]);
+    std::printf("\n");
+
+    uint64_t items = 0, bytes = 0;
+    double checksum = 0;
+    auto start = clock::now();
+    tomocam::shm::Slot slot;
+    while (true) {
+        if (!ring->read(slot, std::chrono::seconds(wait_s))) {
+            if (ring->finished()) break;
+            std::fprintf(stderr, "%s: producer stalled\n", name.c_str());
+            return 1;
+        }
+        if (is_float) {
+            auto *p = reinterpret_cast<const float *>(slot.data);
+            double sum = 0;
+            for (uint32_t i = 0; i < slot.hdr->nbytes / sizeof(float); i++) sum += p[i];
+            checksum += sum;
+        }
+        if (verbose) {
+            const int64_t *m = slot.hdr->meta;
+            std::printf("%llu: tag %lld slice %lld origin (%lld, %lld) shape",
+                        static_cast<unsigned long long>(slot.pos), static_cast<long long>(m[0]),
+                        static_cast<long long>(m[1]), static_cast<long long>(m[2]),
+                        static_cast<long long>(m[3]));
+            for (uint32_t d = 0; d < h->ndim; d++)
+                std::printf("%s%u", d ? " x " : " ", slot.hdr->shape[d]);
+            std::printf("\n");
+        }
+        items++;
+        bytes += slot.hdr->nbytes;
+        ring->release(slot);
+    }
+    double secs = std::chrono::duration<double>(clock::now() - start).count();
+    std::printf("%llu items, %.1f MB in %.2f s (%.0f items/s), checksum %.6g\n",
+                static_cast<unsigned long long>(items), bytes / 1e6, secs,
+                secs > 0 ? items / secs : 0.0, checksum);
+    return 0;
+}
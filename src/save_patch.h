@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "io/array.h"
+#include "io/async_writer.h"
+#include "io/shm_ring.h"
+#include "io/thread_pool.h"
+#include "io/tiff/tiffio.h"
+#include "io/trace.h"
+
+#ifndef SAVE_PATCH__H
+#define SAVE_PATCH__H
+
+namespace tomocam {
+
+    constexpr uint32_t PATCH_SIZE = 256;
+
+    // fraction of the work done; return false to stop early
+    using Progress = std::function<bool(double)>;
+
+    /** clamp a patch centre so that the whole patch lies inside the slice
+     * @param c requested centre along one axis
+     * @param n extent of the slice along that axis
+     * @return index of the first row/column of the patch
+     */
+    inline uint32_t patch_origin(uint32_t c, uint32_t n) {
+        if (n <= PATCH_SIZE) return 0;
+        uint32_t half = PATCH_SIZE / 2;
+        uint32_t start = (c > half) ? c - half : 0;
+        return std::min(start, n - PATCH_SIZE);
+    }
+
+    /** window of PATCH_SIZE x PATCH_SIZE centered at loc, no copy
+     * @param volume image stack
+     * @param loc {slice, y, x} of the patch centre
+     */
+    template <typename T>
+    View2D<T> patch_view(const Array<T> &volume, dims_t loc) {
+        uint32_t ny = std::min(PATCH_SIZE, volume.nrows());
+        uint32_t nx = std::min(PATCH_SIZE, volume.ncols());
+        uint32_t y0 = patch_origin(loc.n1, volume.nrows());
+        uint32_t x0 = patch_origin(loc.n2, volume.ncols());
+        return volume.view(loc.n0, y0, x0, ny, nx);
+    }
+
+    /** save the patch centered at loc as tiff
+     * @param filename output file
+     * @param volume image stack
+     * @param loc {slice, y, x} of the patch centre
+     * @param opts tiff compression options
+     */
+    template <typename T>
+    void save_patch(const std::string &filename, const Array<T> &volume,
+        dims_t loc, const tiff::WriteOptions &opts = {}) {
+        TOMOCAM_TRACE_SCOPE("save_patch", "export");
+        tiff::write(filename, patch_view(volume, loc), opts);
+    }
+
+    /** write patches as dir/NNNNN.tif, numbered from first
+     * Patches are views into volume: they are encoded to memory on a
+     * thread pool, then written out in batches by the async writer.
+     * @param volume image stack
+     * @param locs {slice, y, x} patch centres
+     * @param dir output directory, must exist
+     * @param first number of the first patch file
+     * @param opts tiff compression options
+     * @param progress called as patches complete, false skips the rest
+     * @return number of patches written
+     */
+    template <typename T>
+    uint64_t write_patches(const Array<T> &volume, const std::vector<dims_t> &locs,
+        const std::filesystem::path &dir, int first,
+        const tiff::WriteOptions &opts = {}, const Progress &progress = {}) {
+        TOMOCAM_TRACE_SCOPE("write_patches", "export");
+        // tasks use these by reference: the pool, declared after them, is
+        // destroyed (and runs what is left in its queue) before they are
+        aio::AsyncWriter writer;
+        std::atomic<bool> stop{false};
+        std::atomic<uint64_t> written{0};
+        ThreadPool pool;
+        std::vector<std::future<void>> jobs;
+        jobs.reserve(locs.size());
+
+        int counter = first;
+        for (auto loc : locs) {
+            char pname[20];
+            snprintf(pname, 20, "%05d.tif", counter++);
+            auto path = (dir / pname).string();
+            auto view = patch_view(volume, loc);
+            jobs.push_back(pool.submit([&writer, &stop, &written, path, view, opts] {
+                if (stop) return;
+                writer.submit(path, tiff::encode(view, opts));
+                written++;
+            }));
+        }
+        try {
+            for (size_t i = 0; i < jobs.size(); i++) {
+                jobs[i].get();
+                if (progress && !stop && !progress(double(i + 1) / jobs.size())) stop = true;
+            }
+        } catch (...) {
+            stop = true; // queued tasks return at once while the pool drains
+            throw;
+        }
+        writer.wait();
+        return written;
+    }
+
+    /** stream patches into a shared memory ring instead of writing files
+     * Threads claim ring slots and copy the patch rows straight from the
+     * volume into them, so nothing touches the filesystem. Slot metadata
+     * is {tag, slice, y0, x0} with y0, x0 the patch origin, and every
+     * item carries its shape, which is smaller than PATCH_SIZE x PATCH_SIZE
+     * for small volumes.
+     * @param volume image stack
+     * @param locs {slice, y, x} patch centres
+     * @param ring ring of 2D T items at least as large as the patches
+     * @param tag stored with every patch, e.g. the scan number
+     * @param timeout wait for a free slot before giving up on the consumer
+     * @param progress called as patches complete, false skips the rest
+     * @return number of patches streamed
+     */
+    template <typename T>
+    uint64_t stream_patches(const Array<T> &volume, const std::vector<dims_t> &locs,
+        shm::Ring &ring, int64_t tag = 0,
+        std::chrono::milliseconds timeout = std::chrono::seconds(30),
+        const Progress &progress = {}) {
+        TOMOCAM_TRACE_SCOPE("stream_patches", "export");
+        uint32_t ny = std::min(PATCH_SIZE, volume.nrows());
+        uint32_t nx = std::min(PATCH_SIZE, volume.ncols());
+        const shm::Header *h = ring.header();
+        if (std::strcmp(h->dtype, shm::numpy_dtype<T>()) != 0 || h->ndim != 2)
+            throw std::runtime_error("ring items are not 2D patches of this sample type");
+        if (h->shape[0] < ny || h->shape[1] < nx)
+            throw std::runtime_error("ring items are smaller than the patches");
+
+        std::atomic<bool> stop{false};
+        std::atomic<bool> stalled{false};
+        std::atomic<uint64_t> streamed{0};
+        uint32_t nbytes = ny * nx * sizeof(T);
+
+#pragma omp parallel for schedule(dynamic)
+        for (int64_t i = 0; i < int64_t(locs.size()); i++) {
+            if (stop) continue;
+            auto view = patch_view(volume, locs[i]);
+            shm::Slot slot;
+            if (!ring.acquire(slot, timeout)) {
+                stalled = stop = true;
+                continue;
+            }
+            T *dst = reinterpret_cast<T *>(slot.data);
+            for (uint32_t j = 0; j < ny; j++) std::copy_n(view.row(j), nx, dst + size_t(j) * nx);
+            ring.commit(slot, nbytes,
+                {tag, int64_t(locs[i].n0), int64_t(patch_origin(locs[i].n1, volume.nrows())),
+                    int64_t(patch_origin(locs[i].n2, volume.ncols()))},
+                {ny, nx, 0, 0});
+
+            uint64_t n = ++streamed;
+            if (progress) {
+#pragma omp critical(stream_progress)
+                if (!stop && !progress(double(n) / locs.size())) stop = true;
+            }
+        }
+        if (stalled) throw std::runtime_error("ring consumer stopped reading");
+        return streamed;
+    }
+
+    /** one past the highest NNNNN.tif in dir, so repeated exports into the
+     * same directory never overwrite earlier patches
+     */
+    inline int next_patch_index(const std::filesystem::path &dir) {
+        int next = 0;
+        std::error_code ec;
+        for (auto &e : std::filesystem::directory_iterator(dir, ec)) {
+            auto stem = e.path().stem().string();
+            if (e.path().extension() != ".tif" || stem.empty() || stem.size() > 9 ||
+                !std::all_of(stem.begin(), stem.end(), [](unsigned char c) { return std::isdigit(c); }))
+                continue;
+            next = std::max(next, std::stoi(stem) + 1);
+        }
+        return next;
+    }
+} // namespace tomocam
+#endif // SAVE_PATCH__H
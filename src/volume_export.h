@@ -0,0 +1,275 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "io/array.h"
+#include "io/hdf5/reader.h"
+#include "io/hdf5/writer.h"
+#include "io/trace.h"
+#include "io/zarr/writer.h"
+#include "patch_sampler.h"
+#include "save_patch.h"
+
+#ifndef VOLUME_EXPORT__H
+#define VOLUME_EXPORT__H
+
+namespace tomocam {
+
+    // output file layout: /patches (N, depth, h, w), /origins (N, 3)
+    struct VolumeExport {
+        std::string filename; // *.zarr writes a Zarr store, else HDF5; replaced if it exists
+        uint32_t depth = 64;
+        int per_slab = 1;
+        int deflate = 0;
+    };
+
+    /** copy the sub-volumes of one slab into dst, (n, depth, ny, nx)
+     * Loops run slice-outer, patch-inner, so each source slice is streamed
+     * once while the rows of every patch that touches it are copied.
+     * @param vol volume or slab holding the sub-volumes
+     * @param zbase index in vol of the first slice of the sub-volumes
+     * @param locs {z0, y centre, x centre} of each sub-volume in this slab
+     * @param depth sub-volume depth
+     * @param dst output buffer
+     */
+    template <typename T>
+    void copy_subvolumes(const Array<T> &vol, uint32_t zbase,
+        const std::vector<dims_t> &locs, uint32_t depth, T *dst) {
+        TOMOCAM_TRACE_SCOPE("copy_subvolumes", "export");
+        uint32_t ny = std::min(PATCH_SIZE, vol.nrows());
+        uint32_t nx = std::min(PATCH_SIZE, vol.ncols());
+        size_t plane = size_t(ny) * nx;
+        size_t item = plane * depth;
+
+#pragma omp parallel for schedule(static)
+        for (int64_t z = 0; z < int64_t(depth); z++) {
+            for (size_t p = 0; p < locs.size(); p++) {
+                uint32_t y0 = patch_origin(locs[p].n1, vol.nrows());
+                uint32_t x0 = patch_origin(locs[p].n2, vol.ncols());
+                T *out = dst + p * item + z * plane;
+                for (uint32_t j = 0; j < ny; j++)
+                    std::memcpy(out + size_t(j) * nx,
+                        vol.begin() + vol.flatIdx(zbase + z, y0 + j, x0),
+                        nx * sizeof(T));
+            }
+        }
+    }
+
+    namespace detail {
+        template <typename T>
+        void append_slab(const Array<T> &slab, uint32_t zbase,
+            const std::vector<dims_t> &locs,
+            uint32_t depth, std::vector<T> &buf, h5::Appender<T> &patches,
+            h5::Appender<int> &origins) {
+            if (locs.empty()) return;
+            uint32_t ny = std::min(PATCH_SIZE, slab.nrows());
+            uint32_t nx = std::min(PATCH_SIZE, slab.ncols());
+            buf.resize(locs.size() * depth * ny * nx);
+            copy_subvolumes(slab, zbase, locs, depth, buf.data());
+
+            std::vector<int> org;
+            org.reserve(3 * locs.size());
+            for (auto &l : locs) {
+                org.push_back(static_cast<int>(l.n0));
+                org.push_back(static_cast<int>(patch_origin(l.n1, slab.nrows())));
+                org.push_back(static_cast<int>(patch_origin(l.n2, slab.ncols())));
+            }
+            TOMOCAM_TRACE_SCOPE("append_subvolumes", "export");
+            patches.append(buf.data(), locs.size());
+            origins.append(org.data(), locs.size());
+        }
+    } // namespace detail
+
+    inline bool is_zarr(const std::string &filename) {
+        return std::filesystem::path(filename).extension() == ".zarr";
+    }
+
+    /** dir/<stem>_NNN<ext>, one past the highest such file or store in dir,
+     * so a later export never truncates or replaces an earlier one
+     * @param ext ".h5" or ".zarr"
+     */
+    inline std::filesystem::path next_output(const std::filesystem::path &dir,
+        const std::string &stem, const std::string &ext) {
+        int next = 0;
+        std::string prefix = stem + "_";
+        std::error_code ec;
+        for (auto &e : std::filesystem::directory_iterator(dir, ec)) {
+            auto name = e.path().stem().string();
+            if (e.path().extension() != ext || name.size() <= prefix.size() ||
+                name.size() > prefix.size() + 9 || name.compare(0, prefix.size(), prefix) != 0)
+                continue;
+            auto num = name.substr(prefix.size());
+            if (!std::all_of(num.begin(), num.end(), [](unsigned char c) { return std::isdigit(c); }))
+                continue;
+            next = std::max(next, std::stoi(num) + 1);
+        }
+        char suffix[16];
+        std::snprintf(suffix, sizeof(suffix), "_%03d", next);
+        return dir / (stem + suffix + ext);
+    }
+
+    /** write patches or sub-volumes to a Zarr store, /patches and
+     * /origins {slice, y0, x0}
+     * Items are copied, compressed and written by all threads at once,
+     * each to its own chunk file, so no thread waits on a library lock.
+     * @param vol volume holding the items
+     * @param locs {first slice, y centre, x centre} of each item
+     * @param depth sub-volume depth, 0 for 2D patches (N, h, w)
+     * @param path store directory
+     * @param level zlib level, 0 for raw chunks
+     * @param progress called as items complete, false stops the export;
+     * the store then holds the items before the first one not written
+     * @return number of items in the store
+     */
+    template <typename T>
+    uint64_t write_zarr(const Array<T> &vol, const std::vector<dims_t> &locs,
+        uint32_t depth, const std::string &path, int level = 0,
+        const Progress &progress = {}) {
+        TOMOCAM_TRACE_SCOPE("write_zarr", "export");
+        uint32_t ny = std::min(PATCH_SIZE, vol.nrows());
+        uint32_t nx = std::min(PATCH_SIZE, vol.ncols());
+        uint32_t nz = std::max(depth, 1u);
+        size_t plane = size_t(ny) * nx;
+
+        zarr::Writer w(path, level);
+        std::vector<uint64_t> item{ny, nx};
+        if (depth > 0) item.insert(item.begin(), depth);
+        auto patches = w.dataset<T>("patches", item);
+        auto origins = w.dataset<int>("origins", {3});
+
+        std::vector<uint8_t> done(locs.size(), 0);
+        std::atomic<bool> stop{false};
+        std::atomic<uint64_t> count{0};
+        std::exception_ptr error;
+
+#pragma omp parallel
+        {
+            std::vector<T> buf(plane * nz);
+#pragma omp for schedule(dynamic)
+            for (int64_t i = 0; i < int64_t(locs.size()); i++) {
+                if (stop) continue;
+                uint32_t y0 = patch_origin(locs[i].n1, vol.nrows());
+                uint32_t x0 = patch_origin(locs[i].n2, vol.ncols());
+                for (uint32_t z = 0; z < nz; z++)
+                    for (uint32_t j = 0; j < ny; j++)
+                        std::memcpy(buf.data() + z * plane + size_t(j) * nx,
+                            vol.begin() + vol.flatIdx(locs[i].n0 + z, y0 + j, x0),
+                            nx * sizeof(T));
+                int org[3] = {int(locs[i].n0), int(y0), int(x0)};
+                try {
+                    patches.write(i, buf.data());
+                    origins.write(i, org);
+                } catch (...) {
+#pragma omp critical(write_zarr_error)
+                    if (!error) error = std::current_exception();
+                    stop = true;
+                    continue;
+                }
+                done[i] = 1;
+
+                uint64_t n = ++count;
+                if (progress) {
+#pragma omp critical(write_zarr_progress)
+                    if (!stop && !progress(double(n) / locs.size())) stop = true;
+                }
+            }
+        }
+        uint64_t n = std::find(done.begin(), done.end(), 0) - done.begin();
+        patches.truncate(n);
+        origins.truncate(n);
+        if (error) std::rethrow_exception(error);
+        return n;
+    }
+
+    /** cut depth x PATCH_SIZE x PATCH_SIZE sub-volumes from an in-memory
+     * volume and write them to a chunked HDF5 file, or to a Zarr store
+     * when the file name ends in .zarr
+     * @param progress called after every slab (every item for Zarr),
+     * false stops the export
+     * @return sampling statistics
+     */
+    template <typename T>
+    SampleStats export_volumes(const Array<T> &vol, const Circle &fov,
+        const VolumeExport &opts, const QualityFilter &filter,
+        std::mt19937 &gen, const Progress &progress = {}) {
+        TOMOCAM_TRACE_SCOPE("export_volumes", "export");
+        SampleStats stats;
+        if (is_zarr(opts.filename)) {
+            auto locs = sample_volumes(vol, opts.depth, fov, opts.per_slab, filter, gen, stats);
+            write_zarr(vol, locs, opts.depth, opts.filename, opts.deflate, progress);
+            return stats;
+        }
+        // depth 0 means 2D patches to write_zarr, here it would never advance
+        if (opts.depth == 0) throw std::runtime_error("sub-volume depth must be at least 1");
+        uint32_t ny = std::min(PATCH_SIZE, vol.nrows());
+        uint32_t nx = std::min(PATCH_SIZE, vol.ncols());
+
+        h5::Writer w(opts.filename.c_str());
+        auto patches = w.appender<T>("patches", {opts.depth, ny, nx}, opts.deflate);
+        auto origins = w.appender<int>("origins", {3});
+
+        std::vector<T> buf;
+        for (uint32_t z0 = 0; z0 + opts.depth <= vol.nslices(); z0 += opts.depth) {
+            std::vector<dims_t> locs;
+            sample_slice(vol.slice(z0 + opts.depth / 2), z0, fov, opts.per_slab,
+                filter, gen, stats, locs);
+            detail::append_slab(vol, z0, locs, opts.depth, buf, patches,
+                origins);
+            if (progress && !progress(double(z0 + opts.depth) / vol.nslices())) break;
+        }
+        return stats;
+    }
+
+    /** out-of-core variant: reads one slab of depth slices at a time with a
+     * hyperslab read, so memory is bounded by one slab and no slice is read
+     * twice. Writes HDF5 only.
+     * @param reader open input file
+     * @param dataset 3D dataset name
+     * @param roi block of the dataset to export, zero count for all; fov
+     * and the recorded origins are in its coordinates, as for a volume
+     * loaded with the same roi
+     * @param progress called after every slab, false stops the export
+     */
+    template <typename T>
+    SampleStats export_volumes(h5::Reader &reader, const char *dataset, const Roi &roi,
+        const Circle &fov, const VolumeExport &opts, const QualityFilter &filter,
+        std::mt19937 &gen, const Progress &progress = {}) {
+        TOMOCAM_TRACE_SCOPE("export_volumes", "export");
+        if (is_zarr(opts.filename)) throw std::runtime_error("out-of-core export writes HDF5 only");
+        if (opts.depth == 0) throw std::runtime_error("sub-volume depth must be at least 1");
+        SampleStats stats;
+        dims_t full{uint32_t(reader.dims(dataset, 0)), uint32_t(reader.dims(dataset, 1)),
+            uint32_t(reader.dims(dataset, 2))};
+        Roi r = roi.clip(full);
+        uint32_t ny = std::min(PATCH_SIZE, r.count.n1);
+        uint32_t nx = std::min(PATCH_SIZE, r.count.n2);
+
+        h5::Writer w(opts.filename.c_str());
+        auto patches = w.appender<T>("patches", {opts.depth, ny, nx}, opts.deflate);
+        auto origins = w.appender<int>("origins", {3});
+
+        std::vector<T> buf;
+        for (uint32_t z0 = 0; z0 + opts.depth <= r.count.n0; z0 += opts.depth) {
+            auto slab = reader.read_roi<T>(dataset,
+                Roi{{r.start.n0 + z0, r.start.n1, r.start.n2}, {opts.depth, r.count.n1, r.count.n2}});
+            std::vector<dims_t> locs;
+            sample_slice(slab.slice(opts.depth / 2), z0, fov, opts.per_slab,
+                filter, gen, stats, locs);
+            detail::append_slab(slab, 0, locs, opts.depth, buf, patches,
+                origins);
+            if (progress && !progress(double(z0 + opts.depth) / r.count.n0)) break;
+        }
+        return stats;
+    }
+} // namespace tomocam
+#endif // VOLUME_EXPORT__H
@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "io/array.h"
+#include "io/dtype.h"
+
+using namespace tomocam;
+
+TEST(Roi, ZeroCountRunsToTheEnd) {
+    Roi r = Roi{{2, 0, 5}, {0, 0, 0}}.clip(dims_t{10, 20, 30});
+    EXPECT_EQ(r.start.n0, 2u);
+    EXPECT_EQ(r.count.n0, 8u);
+    EXPECT_EQ(r.count.n1, 20u);
+    EXPECT_EQ(r.count.n2, 25u);
+}
+
+TEST(Roi, CountIsCutAtTheEdge) {
+    Roi r = Roi{{1, 15, 0}, {4, 10, 30}}.clip(dims_t{10, 20, 30});
+    EXPECT_EQ(r.count.n0, 4u);
+    EXPECT_EQ(r.count.n1, 5u);
+    EXPECT_EQ(r.count.n2, 30u);
+}
+
+TEST(Roi, StartOutsideThrows) {
+    EXPECT_THROW(Roi({{10, 0, 0}, {1, 1, 1}}).clip(dims_t{10, 20, 30}), std::runtime_error);
+    EXPECT_THROW(Roi({{0, 0, 30}, {}}).clip(dims_t{10, 20, 30}), std::runtime_error);
+}
+
+TEST(Array, MoveLeavesSourceEmpty) {
+    Array<float> a(2, 3, 4);
+    a.fill(1.f);
+    Array<float> b(std::move(a));
+    EXPECT_EQ(b.size(), 24u);
+    EXPECT_EQ(a.size(), 0u);
+    EXPECT_EQ(a.dims().n0, 0u);
+
+    Array<float> c;
+    c = std::move(b);
+    EXPECT_EQ(c.size(), 24u);
+    EXPECT_EQ(b.size(), 0u);
+    EXPECT_EQ((c[{1, 2, 3}]), 1.f);
+}
+
+TEST(DType, TableRoundTrips) {
+    EXPECT_EQ(dtype_of(Kind::Unsigned, 16), DType::UInt16);
+    EXPECT_EQ(dtype_of(Kind::Signed, 64), DType::Int64);
+    EXPECT_EQ(dtype_of(Kind::Float, 32), DType::Float32);
+    EXPECT_THROW(dtype_of(Kind::Float, 16), std::runtime_error);
+    EXPECT_STREQ(dtype_name(DType::Int8), "int8");
+    EXPECT_STREQ(dtype_traits<uint16_t>::numpy, "<u2");
+}
+
+TEST(DType, VisitCallsTheMatchingType) {
+    const DType all[] = {DType::UInt8, DType::UInt16, DType::UInt32, DType::UInt64,
+        DType::Int8, DType::Int16, DType::Int32, DType::Int64, DType::Float32, DType::Float64};
+    for (DType t : all) {
+        DType seen = visit(t, [](auto tag) { return dtype_v<typename decltype(tag)::type>; });
+        EXPECT_EQ(seen, t);
+    }
+    size_t bytes = visit(DType::Float64, [](auto tag) { return sizeof(typename decltype(tag)::type); });
+    EXPECT_EQ(bytes, sizeof(double));
+}
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "io/async_writer.h"
+
+using namespace tomocam;
+namespace fs = std::filesystem;
+
+namespace {
+    fs::path scratch(const std::string &name) {
+        fs::path dir = fs::temp_directory_path() / ("tomoview_" + name + "_" + std::to_string(::getpid()));
+        fs::remove_all(dir);
+        fs::create_directories(dir);
+        return dir;
+    }
+
+    std::string slurp(const fs::path &p) {
+        std::ifstream in(p, std::ios::binary);
+        return {std::istreambuf_iterator<char>(in), {}};
+    }
+
+    std::vector<uint8_t> bytes(const std::string &s) { return {s.begin(), s.end()}; }
+
+    // AsyncWriter's interface over a backend used directly
+    struct PoolWriter {
+        aio::PoolBackend &b;
+        void submit(std::string p, std::vector<uint8_t> d) { b.submit({std::move(p), std::move(d)}); }
+        void wait() { b.wait(); }
+    };
+
+    template <typename W>
+    void writes_files(W &w, const fs::path &dir) {
+        for (int i = 0; i < 40; i++)
+            w.submit((dir / (std::to_string(i) + ".bin")).string(), bytes("item " + std::to_string(i)));
+        w.wait();
+        for (int i = 0; i < 40; i++) EXPECT_EQ(slurp(dir / (std::to_string(i) + ".bin")), "item " + std::to_string(i));
+    }
+
+    template <typename W>
+    void reports_errors(W &w, const fs::path &dir) {
+        w.submit((dir / "ok.bin").string(), bytes("fine"));
+        w.submit((dir / "missing" / "bad.bin").string(), bytes("lost"));
+        try {
+            w.wait();
+            FAIL() << "no error reported";
+        } catch (const std::runtime_error &e) {
+            EXPECT_NE(std::string(e.what()).find("bad.bin"), std::string::npos) << e.what();
+        }
+        EXPECT_EQ(slurp(dir / "ok.bin"), "fine");
+
+        // the error is reported once, later batches start clean
+        w.submit((dir / "again.bin").string(), bytes("x"));
+        EXPECT_NO_THROW(w.wait());
+    }
+} // namespace
+
+TEST(AsyncWriter, WritesEveryFile) {
+    auto dir = scratch("aw_write");
+    aio::AsyncWriter w(8, 4);
+    writes_files(w, dir);
+    fs::remove_all(dir);
+}
+
+TEST(AsyncWriter, ReportsTheFailedPath) {
+    auto dir = scratch("aw_error");
+    aio::AsyncWriter w(8, 4);
+    reports_errors(w, dir);
+    fs::remove_all(dir);
+}
+
+TEST(PoolBackend, WritesEveryFile) {
+    auto dir = scratch("pool_write");
+    aio::PoolBackend b(8, 2);
+    PoolWriter w{b};
+    writes_files(w, dir);
+    fs::remove_all(dir);
+}
+
+TEST(PoolBackend, ReportsTheFailedPath) {
+    auto dir = scratch("pool_error");
+    aio::PoolBackend b(8, 2);
+    PoolWriter w{b};
+    reports_errors(w, dir);
+    fs::remove_all(dir);
+}
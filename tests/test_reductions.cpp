@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "io/array.h"
+#include "io/integral.h"
+#include "io/reductions.h"
+
+using namespace tomocam;
+
+namespace {
+    // spans several CHUNKs and ends in a partial one
+    std::vector<float> noise(size_t n, uint32_t seed) {
+        std::mt19937 gen(seed);
+        std::normal_distribution<float> dist(100.f, 25.f);
+        std::vector<float> v(n);
+        for (auto &x : v) x = dist(gen);
+        return v;
+    }
+} // namespace
+
+TEST(Reductions, MinMaxMatchesSerial) {
+    auto v = noise(3 * reduce::CHUNK + 123, 1);
+    auto mm = reduce::minmax(v.data(), v.size());
+    EXPECT_EQ(mm.min, *std::min_element(v.begin(), v.end()));
+    EXPECT_EQ(mm.max, *std::max_element(v.begin(), v.end()));
+    EXPECT_THROW(reduce::minmax(v.data(), 0), std::runtime_error);
+}
+
+TEST(Reductions, MomentsMatchSerial) {
+    auto v = noise(5 * reduce::CHUNK + 7, 2);
+    double sum = 0;
+    for (float x : v) sum += x;
+    double mean = sum / v.size();
+    double m2 = 0;
+    for (float x : v) m2 += (x - mean) * (x - mean);
+
+    auto m = reduce::moments(v.data(), v.size());
+    EXPECT_EQ(m.count, v.size());
+    EXPECT_NEAR(m.mean, mean, 1e-9 * std::abs(mean));
+    EXPECT_NEAR(m.variance, m2 / v.size(), 1e-9 * m2 / v.size());
+}
+
+TEST(Reductions, HistogramMatchesSerial) {
+    auto v = noise(2 * reduce::CHUNK + 99, 3);
+    v[0] = NAN;
+    const uint32_t nbins = 64;
+    const double lo = 50, hi = 150;
+    std::vector<uint64_t> counts(nbins, 0);
+    uint64_t below = 0, above = 0;
+    for (float x : v) {
+        if (x < lo) below++;
+        else if (!(x <= hi)) above++;
+        else counts[std::min<uint32_t>(uint32_t((x - lo) * nbins / (hi - lo)), nbins - 1)]++;
+    }
+
+    auto h = reduce::histogram(v.data(), v.size(), nbins, lo, hi);
+    EXPECT_EQ(h.counts, counts);
+    EXPECT_EQ(h.below, below);
+    EXPECT_EQ(h.above, above);
+}
+
+TEST(Reductions, OtsuSplitsTwoModes) {
+    std::vector<float> v(1000, 10.f);
+    std::fill(v.begin() + 600, v.end(), 90.f);
+    double t = reduce::otsu_threshold(reduce::histogram(v.data(), v.size(), 100, 0, 100));
+    EXPECT_GT(t, 10);
+    EXPECT_LT(t, 90);
+}
+
+TEST(IntegralImage, StatsMatchBruteForce) {
+    const uint32_t ny = 37, nx = 53;
+    auto v = noise(size_t(ny) * nx, 4);
+    Slice<float> s{ny, nx, v.data()};
+    const double thresh = 100;
+    IntegralImage sat(s, thresh);
+
+    std::mt19937 gen(5);
+    for (int t = 0; t < 200; t++) {
+        uint32_t y0 = gen() % ny, x0 = gen() % nx;
+        uint32_t h = 1 + gen() % (ny - y0), w = 1 + gen() % (nx - x0);
+        double sum = 0, sq = 0, fg = 0;
+        for (uint32_t j = y0; j < y0 + h; j++)
+            for (uint32_t k = x0; k < x0 + w; k++) {
+                double x = v[size_t(j) * nx + k];
+                sum += x;
+                sq += x * x;
+                fg += x > thresh;
+            }
+        double n = double(h) * w;
+        double mean = sum / n;
+        auto st = sat.stats(y0, x0, h, w);
+        EXPECT_NEAR(st.mean, mean, 1e-9 * std::abs(mean));
+        EXPECT_NEAR(st.variance, std::max(0.0, sq / n - mean * mean), 1e-6);
+        EXPECT_DOUBLE_EQ(st.fg_fraction, fg / n);
+    }
+}
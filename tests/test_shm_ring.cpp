@@ -0,0 +1,221 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "io/shm_ring.h"
+#include "save_patch.h"
+
+using namespace tomocam;
+using namespace std::chrono_literals;
+
+namespace {
+    std::string ring_name(const char *what) {
+        return "/tomoview_test_" + std::string(what) + "_" + std::to_string(::getpid());
+    }
+
+    // drain the ring; items carry {producer, sequence} in the metadata
+    std::vector<std::vector<int64_t>> consume(shm::Ring &ring, int producers) {
+        std::vector<std::vector<int64_t>> seen(producers);
+        shm::Slot s;
+        while (ring.read(s, 5000ms)) {
+            int64_t v;
+            std::memcpy(&v, s.data, sizeof(v));
+            EXPECT_EQ(s.hdr->nbytes, sizeof(v));
+            EXPECT_EQ(v, s.hdr->meta[0] * 1000000 + s.hdr->meta[1]);
+            seen.at(s.hdr->meta[0]).push_back(s.hdr->meta[1]);
+            ring.release(s);
+        }
+        return seen;
+    }
+
+    void produce(shm::Ring &ring, int64_t id, int64_t n) {
+        for (int64_t i = 0; i < n; i++) {
+            int64_t v = id * 1000000 + i;
+            ASSERT_TRUE(ring.push(&v, sizeof(v), {id, i, 0, 0}, 5000ms));
+        }
+    }
+} // namespace
+
+TEST(ShmRing, HeaderDescribesTheItems) {
+    auto ring = shm::Ring::create<float>(ring_name("hdr"), 5, {3, 4});
+    const shm::Header *h = ring.header();
+    EXPECT_EQ(h->magic, shm::MAGIC);
+    EXPECT_EQ(h->slots, 8u); // rounded up to a power of two
+    EXPECT_EQ(h->item_bytes, 3 * 4 * sizeof(float));
+    EXPECT_EQ(h->ndim, 2u);
+    EXPECT_EQ(h->shape[1], 4u);
+    EXPECT_STREQ(h->dtype, "<f4");
+    EXPECT_EQ(h->slot_stride % 64, 0u);
+
+    auto reader = shm::Ring::open(ring.name());
+    EXPECT_EQ(reader.item_bytes(), ring.item_bytes());
+    EXPECT_THROW(ring.push(nullptr, ring.item_bytes() + 1, {}, 0ms), std::runtime_error);
+}
+
+TEST(ShmRing, ManyProducersOneConsumer) {
+    // a small ring so producers keep wrapping around and waiting
+    auto ring = shm::Ring::create<int64_t>(ring_name("mpsc"), 4, {1});
+    const int producers = 4;
+    const int64_t n = 5000;
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) threads.emplace_back([&, p] { produce(ring, p, n); });
+    std::thread closer([&] {
+        for (auto &t : threads) t.join();
+        ring.close();
+    });
+    auto seen = consume(ring, producers);
+    closer.join();
+
+    // every item exactly once, each producer's items in order
+    for (int p = 0; p < producers; p++) {
+        ASSERT_EQ(seen[p].size(), size_t(n));
+        for (int64_t i = 0; i < n; i++) EXPECT_EQ(seen[p][i], i);
+    }
+    EXPECT_TRUE(ring.finished());
+}
+
+TEST(ShmRing, ProducerInAnotherProcess) {
+    auto ring = shm::Ring::create<int64_t>(ring_name("xproc"), 8, {1});
+    const int64_t n = 20000;
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+        // the child maps the segment by name, as an outside producer would
+        auto child = shm::Ring::open(ring.name());
+        for (int64_t i = 0; i < n; i++) {
+            int64_t v = i;
+            if (!child.push(&v, sizeof(v), {0, i, 0, 0}, 5000ms)) _exit(1);
+        }
+        child.close();
+        _exit(0);
+    }
+    auto seen = consume(ring, 1);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    ASSERT_EQ(seen[0].size(), size_t(n));
+    for (int64_t i = 0; i < n; i++) EXPECT_EQ(seen[0][i], i);
+}
+
+TEST(ShmRing, ProducersInTwoProcesses) {
+    auto ring = shm::Ring::create<int64_t>(ring_name("xproc2"), 8, {1});
+    const int producers = 2;
+    const int64_t n = 10000;
+    std::vector<pid_t> pids;
+    for (int p = 0; p < producers; p++) {
+        pid_t pid = fork();
+        ASSERT_GE(pid, 0);
+        if (pid == 0) {
+            auto child = shm::Ring::open(ring.name());
+            for (int64_t i = 0; i < n; i++) {
+                int64_t v = p * 1000000 + i;
+                if (!child.push(&v, sizeof(v), {p, i, 0, 0}, 5000ms)) _exit(1);
+            }
+            _exit(0);
+        }
+        pids.push_back(pid);
+    }
+    std::thread closer([&] {
+        for (pid_t pid : pids) {
+            int status = 0;
+            waitpid(pid, &status, 0);
+            EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        }
+        ring.close();
+    });
+    auto seen = consume(ring, producers);
+    closer.join();
+
+    // interleaved across processes, in order within each
+    for (int p = 0; p < producers; p++) {
+        ASSERT_EQ(seen[p].size(), size_t(n));
+        for (int64_t i = 0; i < n; i++) EXPECT_EQ(seen[p][i], i);
+    }
+}
+
+TEST(ShmRing, ReadTimesOutOnAnEmptyOpenRing) {
+    auto ring = shm::Ring::create<int64_t>(ring_name("empty"), 2, {1});
+    shm::Slot s;
+    EXPECT_FALSE(ring.read(s, 10ms));
+    EXPECT_FALSE(ring.finished());
+    ring.close();
+    EXPECT_FALSE(ring.read(s, 10ms));
+    EXPECT_TRUE(ring.finished());
+}
+
+TEST(StreamPatches, ScansOfDifferentSizesShareTheRing) {
+    // one ring sized for a full patch, as tomoview_batch -S creates it
+    auto ring = shm::Ring::create<float>(ring_name("stream"), 4, {PATCH_SIZE, PATCH_SIZE});
+    auto value = [](uint32_t z, uint32_t y, uint32_t x) { return float(z * 1000000 + y * 1000 + x); };
+    std::vector<Array<float>> scans;
+    for (dims_t d : {dims_t{3, 300, 280}, dims_t{2, 40, 50}}) {
+        Array<float> vol(d.n0, d.n1, d.n2);
+        for (uint32_t z = 0; z < d.n0; z++)
+            for (uint32_t y = 0; y < d.n1; y++)
+                for (uint32_t x = 0; x < d.n2; x++) vol[{z, y, x}] = value(z, y, x);
+        scans.push_back(std::move(vol));
+    }
+    std::vector<std::vector<dims_t>> locs = {
+        {{0, 150, 140}, {1, 10, 270}, {2, 299, 0}, {0, 128, 128}, {1, 200, 100}},
+        {{0, 20, 25}, {1, 0, 49}, {0, 39, 0}}};
+
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+        // the producer runs in another process, as the batch tool does
+        auto child = shm::Ring::open(ring.name());
+        try {
+            for (size_t t = 0; t < scans.size(); t++)
+                if (stream_patches(scans[t], locs[t], child, int64_t(t), 5000ms) != locs[t].size())
+                    _exit(1);
+        } catch (const std::exception &) {
+            _exit(2);
+        }
+        child.close();
+        _exit(0);
+    }
+
+    std::map<int64_t, size_t> count;
+    int64_t last_tag = 0;
+    shm::Slot s;
+    while (ring.read(s, 5000ms)) {
+        const int64_t *m = s.hdr->meta;
+        ASSERT_TRUE(m[0] == 0 || m[0] == 1);
+        EXPECT_GE(m[0], last_tag); // scans arrive one after the other
+        last_tag = m[0];
+        const Array<float> &vol = scans[m[0]];
+        uint32_t ny = std::min(PATCH_SIZE, vol.nrows());
+        uint32_t nx = std::min(PATCH_SIZE, vol.ncols());
+        EXPECT_EQ(s.hdr->shape[0], ny);
+        EXPECT_EQ(s.hdr->shape[1], nx);
+        ASSERT_EQ(s.hdr->nbytes, ny * nx * sizeof(float));
+        auto *p = reinterpret_cast<const float *>(s.data);
+        uint32_t z = uint32_t(m[1]), y0 = uint32_t(m[2]), x0 = uint32_t(m[3]);
+        EXPECT_EQ(p[0], value(z, y0, x0));
+        EXPECT_EQ(p[size_t(ny) * nx - 1], value(z, y0 + ny - 1, x0 + nx - 1));
+        count[m[0]]++;
+        ring.release(s);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    EXPECT_EQ(count[0], locs[0].size());
+    EXPECT_EQ(count[1], locs[1].size());
+    EXPECT_TRUE(ring.finished());
+}
+
+TEST(StreamPatches, RejectsARingTooSmallForThePatches) {
+    auto ring = shm::Ring::create<float>(ring_name("small"), 2, {16, 16});
+    Array<float> vol(1, 64, 64);
+    vol.fill(0.f);
+    EXPECT_THROW(stream_patches(vol, {{0, 32, 32}}, ring), std::runtime_error);
+}
@@ -0,0 +1,80 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "io/slice_cache.h"
+
+using namespace tomocam;
+
+namespace {
+    void fill_with(Slice<float> s, float v) {
+        for (uint64_t i = 0; i < s.size(); i++) s[i] = v;
+    }
+} // namespace
+
+TEST(SliceCache, ConcurrentMissesFillOnce) {
+    SliceCache<float> cache(1 << 20);
+    std::atomic<int> fills{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; t++)
+        threads.emplace_back([&] {
+            auto h = cache.get({1, 7}, 4, 4, [&](Slice<float> s) {
+                fills++;
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                fill_with(s, 7.f);
+            });
+            EXPECT_EQ(h.view().row(3)[3], 7.f);
+        });
+    for (auto &t : threads) t.join();
+
+    EXPECT_EQ(fills.load(), 1);
+    auto st = cache.stats();
+    EXPECT_EQ(st.misses, 1u);
+    EXPECT_EQ(st.hits, 7u);
+    EXPECT_EQ(st.entries, 1u);
+}
+
+TEST(SliceCache, FailedFillReachesWaitersAndIsRetried) {
+    SliceCache<float> cache(1 << 20);
+    auto fail = [](Slice<float>) { throw std::runtime_error("read error"); };
+    EXPECT_THROW(cache.get({1, 0}, 2, 2, fail), std::runtime_error);
+    EXPECT_FALSE(cache.contains({1, 0}));
+
+    auto h = cache.get({1, 0}, 2, 2, [](Slice<float> s) { fill_with(s, 1.f); });
+    EXPECT_EQ(h.view().row(0)[0], 1.f);
+}
+
+TEST(SliceCache, EvictsUnpinnedSlicesOverBudget) {
+    const uint32_t n = 16; // 1 KiB slices
+    const uint64_t slice = n * n * sizeof(float);
+    SliceCache<float> cache(4 * slice);
+
+    auto pinned = cache.get({1, 0}, n, n, [](Slice<float> s) { fill_with(s, 0.f); });
+    for (uint32_t i = 1; i < 20; i++)
+        cache.get({1, i}, n, n, [i](Slice<float> s) { fill_with(s, float(i)); });
+
+    auto st = cache.stats();
+    EXPECT_LE(st.bytes, 4 * slice);
+    EXPECT_GE(st.evictions, 15u);
+    EXPECT_TRUE(cache.contains({1, 0})); // pinned slices stay
+    EXPECT_EQ(pinned.view().row(0)[0], 0.f);
+
+    pinned.reset();
+    cache.drop(1);
+    EXPECT_EQ(cache.stats().bytes, 0u);
+}
+
+TEST(SliceCache, PinnedSlicesMayExceedTheBudget) {
+    const uint32_t n = 16;
+    SliceCache<float> cache(n * n * sizeof(float));
+    std::vector<SliceCache<float>::Handle> held;
+    for (uint32_t i = 0; i < 3; i++)
+        held.push_back(cache.get({2, i}, n, n, [](Slice<float> s) { fill_with(s, 1.f); }));
+    EXPECT_EQ(cache.stats().entries, 3u);
+    EXPECT_EQ(cache.stats().evictions, 0u);
+}
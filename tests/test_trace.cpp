@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+#include "io/trace.h"
+
+using namespace tomocam;
+namespace fs = std::filesystem;
+
+namespace {
+    std::string slurp(const fs::path &p) {
+        std::ifstream in(p, std::ios::binary);
+        return {std::istreambuf_iterator<char>(in), {}};
+    }
+} // namespace
+
+TEST(Tracer, FullBufferKeepsTheNewestEvents) {
+    auto &t = trace::Tracer::instance();
+    t.set_capacity(8);
+    t.clear();
+    // a fresh thread gets a buffer sized by the new capacity
+    std::thread([&] {
+        for (uint64_t i = 0; i < 20; i++) t.record("step", "test", 1000 + i, 1);
+    }).join();
+    EXPECT_EQ(t.dropped(), 12u);
+
+    fs::path file = fs::temp_directory_path() / ("tomoview_trace_" + std::to_string(::getpid()) + ".json");
+    ASSERT_TRUE(t.dump(file.string()));
+    std::string json = slurp(file);
+    EXPECT_NE(json.find("\"dropped_events\":12"), std::string::npos) << json;
+    EXPECT_EQ(json.find("\"ts\":1011,"), std::string::npos);
+    // the kept events are written oldest first
+    auto first = json.find("\"ts\":1012,");
+    auto last = json.find("\"ts\":1019,");
+    ASSERT_NE(first, std::string::npos);
+    ASSERT_NE(last, std::string::npos);
+    EXPECT_LT(first, last);
+    fs::remove(file);
+
+    t.clear();
+    EXPECT_EQ(t.dropped(), 0u);
+    t.set_capacity(trace::TRACE_EVENTS_PER_THREAD);
+}
@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include "io/zarr/writer.h"
+
+using namespace tomocam;
+namespace fs = std::filesystem;
+
+namespace {
+    fs::path scratch(const std::string &name) {
+        fs::path dir = fs::temp_directory_path() / ("tomoview_" + name + "_" + std::to_string(::getpid()));
+        fs::remove_all(dir);
+        return dir;
+    }
+
+    std::string slurp(const fs::path &p) {
+        std::ifstream in(p, std::ios::binary);
+        return {std::istreambuf_iterator<char>(in), {}};
+    }
+} // namespace
+
+TEST(Zarr, MetadataCoversItemsWritten) {
+    auto root = scratch("zarr_meta");
+    {
+        zarr::Writer w(root, 0);
+        auto ds = w.dataset<uint16_t>("patches", {2, 3});
+        std::vector<uint16_t> item(6, 5);
+        for (uint64_t i : {0, 2, 1}) ds.write(i, item.data());
+        EXPECT_EQ(ds.size(), 3u);
+    }
+    EXPECT_NE(slurp(root / ".zgroup").find("\"zarr_format\": 2"), std::string::npos);
+    std::string meta = slurp(root / "patches" / ".zarray");
+    EXPECT_NE(meta.find("\"shape\": [3, 2, 3]"), std::string::npos) << meta;
+    EXPECT_NE(meta.find("\"chunks\": [1, 2, 3]"), std::string::npos) << meta;
+    EXPECT_NE(meta.find("\"dtype\": \"<u2\""), std::string::npos) << meta;
+    EXPECT_NE(meta.find("\"compressor\": null"), std::string::npos) << meta;
+    EXPECT_EQ(fs::file_size(root / "patches" / "1.0.0"), 6 * sizeof(uint16_t));
+    fs::remove_all(root);
+}
+
+TEST(Zarr, TruncateShrinksTheShape) {
+    auto root = scratch("zarr_truncate");
+    {
+        zarr::Writer w(root, 1);
+        auto ds = w.dataset<float>("volumes", {2, 2, 2});
+        std::vector<float> item(8, 1.f);
+        for (uint64_t i = 0; i < 5; i++) ds.write(i, item.data());
+        ds.truncate(3);
+        ds.truncate(4); // never grows back
+        EXPECT_EQ(ds.size(), 3u);
+    }
+    std::string meta = slurp(root / "volumes" / ".zarray");
+    EXPECT_NE(meta.find("\"shape\": [3, 2, 2, 2]"), std::string::npos) << meta;
+    EXPECT_NE(meta.find("\"id\": \"zlib\""), std::string::npos) << meta;
+    // chunks past the shape are gone, the rest are kept
+    EXPECT_TRUE(fs::exists(root / "volumes" / "2.0.0.0"));
+    EXPECT_FALSE(fs::exists(root / "volumes" / "3.0.0.0"));
+    EXPECT_FALSE(fs::exists(root / "volumes" / "4.0.0.0"));
+    fs::remove_all(root);
+}
+
+TEST(Zarr, CompressedChunksDecode) {
+    auto root = scratch("zarr_zlib");
+    std::vector<int32_t> item(64);
+    for (int i = 0; i < 64; i++) item[i] = i * i;
+    {
+        zarr::Writer w(root, 6);
+        auto ds = w.dataset<int32_t>("origins", {64});
+        ds.write(0, item.data());
+    }
+    std::string z = slurp(root / "origins" / "0.0");
+    std::vector<int32_t> back(64);
+    uLongf n = back.size() * sizeof(int32_t);
+    ASSERT_EQ(uncompress(reinterpret_cast<Bytef *>(back.data()), &n,
+                  reinterpret_cast<const Bytef *>(z.data()), z.size()),
+        Z_OK);
+    EXPECT_EQ(back, item);
+    fs::remove_all(root);
+}